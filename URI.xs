@@ -10,7 +10,37 @@ using xs::lib::sv2string;
 using std::cout;
 using std::endl;
 
-static char unsafe_query_component_plus[256];
+static const char* part_names[URIView::PARTS_COUNT] = {"scheme", "user_info", "host", "port", "path", "query", "fragment"};
+static U32         part_hashes[URIView::PARTS_COUNT];
+
+#define STAT_FIELD(name) {#name, offsetof(stats_t, name)}
+static const struct { const char* name; size_t offset; } stat_fields[] = {
+    STAT_FIELD(parse),       STAT_FIELD(parse_bytes),
+    STAT_FIELD(to_string),   STAT_FIELD(to_string_hits),     STAT_FIELD(to_string_bytes),
+    STAT_FIELD(query_sync),  STAT_FIELD(query_sync_hits),    STAT_FIELD(parse_query_bytes),
+    STAT_FIELD(qstr_sync),   STAT_FIELD(qstr_sync_hits),     STAT_FIELD(qstr_sync_bytes),
+    STAT_FIELD(query_hv_sync), STAT_FIELD(query_hv_sync_hits),
+    STAT_FIELD(encode),      STAT_FIELD(encode_bytes),
+    STAT_FIELD(decode),      STAT_FIELD(decode_skips),       STAT_FIELD(decode_bytes),
+};
+
+static InternPool* intern_pool; // process-wide, never freed as uris keep referencing its strings
+
+// pushes (route id, captures...) of successful match
+static inline void push_route_match (SV**& sp, const RouteMatch& m) {
+    EXTEND(sp, (I32)m.ncaptures + 1);
+    mPUSHi(m.route);
+    for (size_t i = 0; i < m.ncaptures; ++i) {
+        string capture = m.capture(i);
+        mPUSHp(capture.data(), capture.length());
+    }
+}
+
+static inline SV* part_sv (const URIView& view, int part) {
+    if (part == URIView::PORT) return newSVuv(view.port());
+    URIView::span_t span = view.span((URIView::part_t)part);
+    return newSVpvn(view.data() + span.start, span.length);
+}
 
 
 MODULE = Panda::URI                PACKAGE = Panda::URI
@@ -21,22 +51,145 @@ XSURI* XT_PANDA_XSURI
 END
 
 BOOT {
-    unsafe_generate(unsafe_query_component_plus, UNSAFE_UNRESERVED);
-    unsafe_query_component_plus[(unsigned char)' '] = '+';
     XSURI::register_perl_scheme("http",  "Panda::URI::http");
     XSURI::register_perl_scheme("https", "Panda::URI::https");
     XSURI::register_perl_scheme("ftp",   "Panda::URI::ftp");
+    for (int i = 0; i < URIView::PARTS_COUNT; ++i) PERL_HASH(part_hashes[i], part_names[i], strlen(part_names[i]));
 }
 
 URIx* uri (string url = string(), int flags = 0) {
-    RETVAL = URI::create(url, flags);
+    try { RETVAL = URI::create(url, flags); }
+    catch (URIError exc) { croak(exc.what()); }
+}
+
+URIx* from_packed (string packed) {
+    PackedURI p;
+    try { p.load(packed); }
+    catch (URIError exc) { croak(exc.what()); }
+    RETVAL = p.to_uri();
 }
 
 void register_scheme (string scheme, string perl_class) {
     XSURI::register_perl_scheme(scheme.data(), perl_class.data());
 }
+
+void split_uri (string url, int flags = 0) {
+    URIView view(url, flags);
+    EXTEND(SP, URIView::PARTS_COUNT);
+    for (int i = 0; i < URIView::PARTS_COUNT; ++i) mPUSHs(part_sv(view, i));
+}
+
+void uri_error (string url, int flags = 0) {
+    URIView view(url, flags | URI::VALIDATE);
+    if (view.valid()) XSRETURN_EMPTY;
+    EXTEND(SP, 2);
+    mPUSHu(view.error_offset());
+    mPUSHp(URIView::part_name(view.error_part()), strlen(URIView::part_name(view.error_part())));
+}
+
+SV* split_uri_list (AV* urls, int flags = 0, bool as_hash = false) {
+    I32 cnt = av_len(urls) + 1;
+    AV* ret = newAV();
+    if (cnt) av_extend(ret, cnt - 1);
+    URIView view;
+    for (I32 i = 0; i < cnt; ++i) {
+        SV** elemref = av_fetch(urls, i, 0);
+        if (!elemref || !SvOK(*elemref)) {
+            av_store(ret, i, newSV(0));
+            continue;
+        }
+        STRLEN len;
+        const char* str = SvPV(*elemref, len);
+        view.parse(str, len, flags);
+        if (as_hash) {
+            HV* parts = newHV();
+            for (int j = 0; j < URIView::PARTS_COUNT; ++j)
+                hv_store(parts, part_names[j], strlen(part_names[j]), part_sv(view, j), part_hashes[j]);
+            av_store(ret, i, newRV_noinc((SV*)parts));
+        } else {
+            AV* parts = newAV();
+            av_extend(parts, URIView::PARTS_COUNT - 1);
+            for (int j = 0; j < URIView::PARTS_COUNT; ++j) av_store(parts, j, part_sv(view, j));
+            av_store(ret, i, newRV_noinc((SV*)parts));
+        }
+    }
+    RETVAL = newRV_noinc((SV*)ret);
+}
+
+string build_query (HV* query, int flags = 0) {
+    XSURI::build_query(query, RETVAL, flags & URI::PARAM_DELIM_SEMICOLON ? ';' : '&');
+}
+
+SV* stats () {
+    const stats_t& st = panda::uri::stats();
+    HV* ret = newHV();
+    for (size_t i = 0; i < sizeof(stat_fields)/sizeof(stat_fields[0]); ++i) {
+        uint64_t val = *(const uint64_t*)((const char*)&st + stat_fields[i].offset);
+        hv_store(ret, stat_fields[i].name, strlen(stat_fields[i].name), newSVuv(val), 0);
+    }
+    RETVAL = newRV_noinc((SV*)ret);
+}
+
+void reset_stats () {
+    panda::uri::reset_stats();
+}
+
+void intern (bool enable = true, SV* max_size = NULL, SV* max_len = NULL) {
+    if (enable) {
+        size_t size = max_size ? SvUV(max_size) : 65536;
+        size_t len  = max_len  ? SvUV(max_len)  : 255;
+        if (!intern_pool) intern_pool = new InternPool(size, len);
+        else if ((max_size && size != intern_pool->max_size()) || (max_len && len != intern_pool->max_len()))
+            croak("Panda::URI::intern: pool already exists with max_size=%" UVuf " and max_len=%" UVuf ", it can't be resized",
+                  (UV)intern_pool->max_size(), (UV)intern_pool->max_len());
+    }
+    InternPool::current(enable ? intern_pool : NULL);
+}
+
+SV* intern_stats () {
+    if (!intern_pool) XSRETURN_UNDEF;
+    InternPool::stats_t st = intern_pool->stats();
+    HV* ret = newHV();
+    hv_store(ret, "size",    4, newSVuv(st.size),    0);
+    hv_store(ret, "bytes",   5, newSVuv(st.bytes),   0);
+    hv_store(ret, "lookups", 7, newSVuv(st.lookups), 0);
+    hv_store(ret, "hits",    4, newSVuv(st.hits),    0);
+    RETVAL = newRV_noinc((SV*)ret);
+}
+
+#ifdef PANDA_URI_TEST
+
+# for tests: uris created outside of arena scope are changed inside it and must survive clear() and reuse of arena's memory
+string _arena_test (string url, string query) {
+    Arena arena(1024);
+    URI* heap = new URI(url);
+    URI shared(*heap);
+    {
+        Arena::Scope scope(arena);
+        heap->query(query);
+        URI copy(*heap);
+        copy.query().insert("arena", "1");
+        shared.query().insert("shared", "1");
+        heap->query().insert("heap", "1");
+        delete new URI(*heap);
+    }
+    arena.clear();
+    {
+        Arena::Scope scope(arena);
+        for (int i = 0; i < 16; ++i) memset(arena.allocate(512), 'X', 512);
+    }
+    RETVAL = heap->to_string();
+    RETVAL += " ";
+    RETVAL += shared.to_string();
+    delete heap;
+}
+
+#endif
     
 INCLUDE: encode.xsi
 INCLUDE: URI.xsi
 INCLUDE: schemas.xsi
 INCLUDE: cloning.xsi
+INCLUDE: router.xsi
+INCLUDE: public_suffix.xsi
+INCLUDE: parser.xsi
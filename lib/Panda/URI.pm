@@ -14,6 +14,14 @@ Panda::URI - fast URI.pm-like framework written in C, with Perl and C interface
 use Panda::Export {
     ALLOW_LEADING_AUTHORITY => 1,
     PARAM_DELIM_SEMICOLON   => 2,
+    QUERY_KEEP_ORDER        => 4,
+    VALIDATE                => 8,
+    HOST_NONE               => 0,
+    HOST_REG_NAME           => 1,
+    HOST_IPV4               => 2,
+    HOST_IPV6               => 3,
+    HOST_IPVFUTURE          => 4,
+    HOST_INVALID            => 5,
 };
 
 require Panda::XSLoader;
@@ -114,6 +122,22 @@ prints "//www.google.com/hello" (scheme-relative format), making it valid
 
 If true, Panda::URI will use ';' as delimiter between query string params instead of a default '&'. Both for input and output.
 
+=item QUERY_KEEP_ORDER
+
+By default query params are sorted by key when query string is composed from params (after changing query via query(),
+add_query(), param(), etc). With this flag params keep the order they came in (params with the same key are grouped together).
+
+=item VALIDATE
+
+By default parser is forgiving: any chars are accepted in any component as is (for example, spaces in path). With this flag
+url is checked against RFC 3986 grammar while parsing: chars which are not allowed in a component must be percent-encoded,
+percent-escapes must be complete (C<%XX>), scheme must begin with a letter, user info may contain only one '@'
+and port must be a number not bigger than 65535. Invalid url croaks with the offset and the component of the first invalid char:
+
+    uri("http://ya.ru/my path", VALIDATE); # croaks "URI: invalid path at offset 15"
+
+See also uri_error().
+
 =back
 
 =head4 register_scheme($scheme, $perl_class)
@@ -126,6 +150,36 @@ when such uris are constructed (even from XS/C code).
 
 See C<REGISTERING SCHEMAS> for how to.
 
+=head4 split_uri($url, [$flags])
+
+Parses $url and returns its components as a list ($scheme, $user_info, $host, $port, $path, $query_string, $fragment) without
+creating an object. Components are returned as they are in $url (host and user_info are not decoded), $port is the same as
+port() method returns (explicit port or default port for the scheme).
+
+    my ($scheme, undef, $host, $port, $path) = split_uri("http://ya.ru/my/path?a=b"); # http, ya.ru, 80, /my/path
+
+$flags are the same as for uri() function.
+
+=head4 uri_error($url, [$flags])
+
+Checks $url as if VALIDATE flag was set, without creating an object and without croaking. Returns empty list if $url is valid,
+or ($offset, $part) otherwise, where $offset is the position of the first invalid char in $url and $part is the name of the
+component it was found in (C<scheme>, C<user_info>, C<host>, C<port>, C<path>, C<query> or C<fragment>).
+
+    my ($offset, $part) = uri_error("http://ya.ru/a%zz"); # 14, path
+
+=head4 split_uri_list(\@urls, [$flags], [$as_hash])
+
+Batch version of split_uri() for processing large lists of urls (logs, etc) in one call. Returns arrayref with one element per url:
+arrayref of components in the same order as split_uri() returns them or, if $as_hash is true, hashref with keys
+C<scheme>, C<user_info>, C<host>, C<port>, C<path>, C<query>, C<fragment>. Undefined elements of @urls result in undef.
+
+    my $list = split_uri_list(["http://ya.ru/a", "https://google.com:8443/b?c=d"], 0, 1);
+    say $list->[1]{port}; # 8443
+
+Per-call overhead of creating objects (or even of calling split_uri() in a loop) is usually bigger than parsing itself,
+so this is a lot faster when you only need components. See misc/bench_batch.plx.
+
 =head4 encode_uri_component($bytes, [$use_plus]), encodeURIComponent($bytes, [$use_plus])
 
 Does what JavaScript's encodeURIComponent does.
@@ -142,7 +196,51 @@ Does what JavaScript's decodeURIComponent does.
     $str = decode_uri_component("http%3A%2F%2Fwww.example.com%2F");
     # http://www.example.com/
 
-=head1 CLASS METHODS
+=head4 from_packed($bytes)
+
+Creates uri object (like uri() does) from binary form returned by packed(), without parsing. Croaks if $bytes are truncated or
+malformed.
+
+=head4 build_query(\%query, [$flags])
+
+Encodes params from hash into query string in one pass, without building any intermediate structures. Values may be arrayrefs to
+make several params with the same key, undefined values give empty ones. Params are written sorted by key, so the result is stable.
+If $flags has PARAM_DELIM_SEMICOLON, params are delimited by ';'.
+
+    say build_query({a => 1, b => [2, 3]}); # a=1&b=2&b=3
+
+query(\%query) and add_query(\%query) use the same encoder, so the query is only parsed if you access its params later.
+
+=head4 stats(), reset_stats()
+
+Returns hashref with counters of hot paths of the current thread: parsing, serialization, query syncing and encoding/decoding
+(see C<stats_t> in L</"C++ INTERFACE"> for the list). reset_stats() sets them all to zero. Counters are only maintained if the module
+is built with C<-DPANDA_URI_STATS> (see Makefile.PL), otherwise all of them are always zero.
+
+    Panda::URI::reset_stats();
+    handle_requests();
+    my $st = Panda::URI::stats();
+    say "to_string() cache hit rate: ", $st->{to_string_hits} / ($st->{to_string} || 1);
+
+=head4 intern([$enable = 1], [$max_size = 65536], [$max_len = 255])
+
+Enables (or disables with false $enable) the process-wide pool of interned strings. While it's enabled, hosts of parsed uris and names
+of query params are kept in the pool, so the same values in many uris share one buffer instead of each uri having its own copy,
+and comparing uris with the same interned host is a pointer comparison. This saves memory when a lot of uris repeat a small set of
+hosts and param names (crawler queues, logs). The pool is created by the first call with the given limits: up to $max_size strings
+of up to $max_len bytes, other values are not interned. It's never freed and disabling just stops adding to it. Later calls reuse
+the pool and croak if they pass limits other than the pool has.
+
+=head4 intern_stats()
+
+Returns hashref with C<size> (strings in pool), C<bytes> (memory it takes), C<lookups> and C<hits> (strings which were already in
+pool) or undef if the pool hasn't been enabled.
+
+    Panda::URI::intern();
+    ...
+    my $st = Panda::URI::intern_stats();
+    say "intern hit rate: ", $st->{hits} / ($st->{lookups} || 1);
+
 
 =head4 new($url, [$flags])
 
@@ -188,6 +286,37 @@ Sets/returns user_info part of uri (ftp://<user_info>@host/...)
 
 Sets/returns host part of uri
 
+=head4 host_type()
+
+Returns kind of host, which is determined whenever host changes: HOST_NONE (no host), HOST_REG_NAME (name to be resolved),
+HOST_IPV4 (dotted-decimal address), HOST_IPV6 (address in brackets, maybe with zone id like C<[fe80::1%25eth0]>), HOST_IPVFUTURE
+(C<[v1.xxx]>) or HOST_INVALID (something in brackets which is not a valid address). With VALIDATE flag invalid addresses are
+rejected while parsing. Constants are exported by Panda::URI.
+
+=head4 host_addr()
+
+Returns binary address (4 bytes for IPv4, 16 for IPv6, in network byte order) if host is an IP address, undef otherwise. It's ready
+for Socket's pack_sockaddr_in()/pack_sockaddr_in6(), so no inet_pton() or resolving is needed.
+
+    my $u = uri("http://[::1]:8080/");
+    my $sa = pack_sockaddr_in6($u->port, $u->host_addr) if $u->host_type == HOST_IPV6;
+
+=head4 host_zone()
+
+Returns zone id of IPv6 address (C<eth0> for C<[fe80::1%25eth0]>) or empty string.
+
+=head4 public_suffix()
+
+Returns public suffix of the host (C<co.uk> for C<www.example.co.uk>) by the Public Suffix List loaded into
+Panda::URI::PublicSuffix, see L</PUBLIC SUFFIX>. Returns undef if no list is loaded or host is not a registered name (an IP address
+or empty). Hosts which no rule matches have their last label as the public suffix, as the list's algorithm prescribes.
+
+=head4 registrable_domain()
+
+Returns public suffix with one more label (C<example.co.uk> for C<www.example.co.uk>), i.e. the part of host under control of a
+single registrant, which is what cookie and same-site checks compare. Returns undef if host itself is a public suffix or in cases
+when public_suffix() returns undef.
+
 =head4 port([$new_port])
 
 Sets/returns port. If no port is explicitly present in uri, returns default port for uri's scheme. If no scheme in uri, returns 0.
@@ -221,6 +350,8 @@ If uri has no query params, empty hash is returned.
 
 If you change returned hash, no changes will occur in uri object.
 To commit these changes, set this hash again via query($hash) or use param() method.
+The same hash is returned every time and it's updated in place when uri's query changes (only values that changed are touched),
+so don't keep your own data in it.
 
 If params are specified, sets new query from hash or hashref or string.
 Keys/values are accepted unencoded for hash/hashref.
@@ -233,12 +364,11 @@ If you want to make query strings like 'a=1&a=2&a=3', set "a"'s value to an arra
     $u->query(b => 10, a => [1,2,3]);
     say $u; # http://ya.ru?b=10&a=1&a=2&a=3
     
-Note hovewer, that multiparams are NOT returned in hashref:
+Params with several values are returned as arrayrefs of values in the order they come in query:
 
-    say Dumper($u->query); # {b => 10, a => 1/2/3 }
-    
-A's value may be any of 1/2/3 depending on hash order. This is done because most of the time you don't want multiparams and don't
-wanna be suprised by an arrayref in query if someone passes you second value for some key.
+    say Dumper($u->query); # {b => 10, a => [1,2,3]}
+
+Use param() if you don't want to be surprised by an arrayref when someone passes you second value for some key.
 
 If you want to get all values of multiparam, use multiparam().
 
@@ -306,7 +436,44 @@ Returns uri, relative to current scheme and location, for example:
     
 =head4 to_string(), as_string(), '""'
 
-Returns the whole uri as string.
+Returns the whole uri as string. The result is cached until the uri is changed, so calling it many times on the same object is
+cheap. Just created and unchanged uri returns the string it was created from, if it has been in canonical form.
+
+=head4 abs($base)
+
+Returns new uri object which is current uri (as a reference) resolved against $base as described in RFC 3986 5.2.
+$base must be a Panda::URI object. Returned object is "strict" (as if created by uri() function).
+
+    say uri("../g?y")->abs(uri("http://a/b/c/d;p?q")); # http://a/b/g?y
+
+=head4 resolve($ref | \@refs)
+
+Resolves reference $ref (string) against current uri and returns the result as string. This is done on parsed components of
+current uri, without serializing and reparsing it, so it is a lot faster than concatenating strings and creating new uri objects.
+
+If arrayref of references is passed, resolves all of them in one call and returns arrayref of results (undefs stay undefs).
+
+    my $base = uri("http://example.com/a/b/page.html");
+    say $base->resolve("../img/logo.png"); # http://example.com/a/img/logo.png
+    my $list = $base->resolve(\@hrefs);
+
+References are parsed with flags of current uri. Note that empty host or query are treated as undefined, so C<"?"> resolves
+to base's query.
+
+=head4 normalize([$sort_query])
+
+Normalizes uri in place as described in RFC 3986 6.2.2: lowercases scheme and host, uppercases hex digits in percent-escapes,
+decodes needlessly encoded unreserved chars (C<%7E> -> C<~>), removes dot segments from path (C</a/./b/../c> -> C</a/c>)
+and drops port if it's the default one for the scheme. If $sort_query is true, also sorts query params by name
+(params with the same name keep their order). Useful for making cache keys.
+
+    my $uri = uri("HTTP://Example.COM:80/a/./b/../%7euser?b=2&a=1");
+    $uri->normalize(1);
+    say $uri; # http://example.com/a/~user?a=1&b=2
+
+=head4 normalized_string([$sort_query])
+
+Returns string of normalized uri without changing the object. It is faster than clone() + normalize() + to_string().
 
 =head4 to_bool(), 'bool'
 
@@ -338,9 +505,24 @@ Same as url($url, [$flags])
 
 Returns true if $other_uri contains the same url (including all parts - query, fragment, etc).
 
+=head4 hash_code()
+
+Returns a number which is the same for equal uris (in terms of equals()), so it can be used as a key for perl hashes without
+stringifying uri. Different uris may (very rarely) have the same hash code, so check them with equals() if it matters.
+The value is cached until uri is changed. Note that hash() is an alias for fragment().
+
+    $seen{$uri->hash_code} ||= $uri;
+
 =head4 clone()
 
-Clones current uri. If current uri is in strict mode, then cloned uri will be in strict mode too.
+Clones current uri. If current uri is in strict mode, then cloned uri will be in strict mode too. Parsed query is shared with the
+clone until one of them changes it, so cloning costs the same regardless of the number of params.
+
+=head4 packed()
+
+Returns compact binary form of uri (see C<PackedURI> in L</"C++ INTERFACE">): a header of 18 bytes (28 for urls longer than 64K)
+followed by the url. It's meant for storing lots of urls and may be turned back into uri object with from_packed(). The form doesn't
+depend on perl or process, but it's native-endian.
 
 =head4 path_segments([@new_segments])
 
@@ -375,6 +557,133 @@ Sets/returns user part of user_info in uri.
 
 Sets/returns password part of user_info in uri.
 
+=head1 ROUTER
+
+Panda::URI::Router dispatches paths by a set of patterns without splitting them into segments in perl. Patterns are compiled into a
+trie of segments, so matching cost doesn't depend on the number of routes.
+
+    my $router = Panda::URI::Router->new;
+    my $user   = $router->add('/users/:id');
+    my $posts  = $router->add('/users/:id/posts/*');
+    my $static = $router->add('/static/*path');
+
+    my ($route, @captures) = $router->match_uri($uri);
+    if    (!defined $route)   { not_found() }
+    elsif ($route == $posts)  { list_posts(@captures) } # ('42', 'tag/perl') for /users/42/posts/tag/perl
+
+Segments are delimited by '/' and empty ones are skipped (like path_segments() does), so '/users//42/' is the same as '/users/42'.
+Pattern segments are literal strings, C<:name> which matches any non-empty segment and C<*> or C<*name>, which may only be the last
+one and matches the rest of the path (possibly empty). Literal segments take precedence over params and params over the rest of the
+path, e.g. '/users/me' wins over '/users/:id' for '/users/me'. Captures are returned decoded, including the rest of the path, so
+'%2F' in it comes out as '/' (C++ RouteMatch::raw() gives undecoded captures).
+
+=head4 new()
+
+=head4 add($pattern)
+
+Adds pattern and returns its route id (routes are numbered from 0 in order they've been added). Croaks if pattern doesn't start with
+'/', has misplaced '*' or empty param name, or if the same pattern (maybe with other param names) is already added.
+
+=head4 match($path)
+
+Returns (route id, captures...) or empty list if nothing matched.
+
+=head4 match_uri($uri)
+
+The same for path of Panda::URI object, doesn't copy it.
+
+=head4 pattern($route)
+
+=head4 params($route)
+
+Returns names of captures of the route in order they're returned by match(). Name of C<*> is '*'.
+
+=head4 size()
+
+Number of routes.
+
+=head4 clear()
+
+Removes all routes.
+
+=head1 PUBLIC SUFFIX
+
+Panda::URI::PublicSuffix keeps the Public Suffix List (L<https://publicsuffix.org/list/>) used by public_suffix() and
+registrable_domain(). The module doesn't ship the list, application provides it. The text of the list is compiled into a flat trie of
+reversed host labels, which is looked up without allocating and without any perl code. Compiled list is a single blob which can be
+saved to a file and then mapped into memory by every process instead of being parsed at startup; its pages are shared between
+processes (and forks) and the list is only read after loading, so it's safe to use from any number of threads.
+
+    # once, e.g. at deploy
+    write_file('psl.bin', Panda::URI::PublicSuffix::compile(read_file('public_suffix_list.dat')));
+
+    # at startup
+    Panda::URI::PublicSuffix::load('psl.bin');
+    say uri("https://www.example.co.uk/")->registrable_domain; # example.co.uk
+
+Rules are matched case-insensitively for ASCII letters and byte-wise otherwise, so IDN labels in the list and in hosts must be in the
+same form (UTF-8 or punycode). Compiled lists are only valid on machines with the same byte order.
+
+=head4 compile($list_text)
+
+Returns compiled blob. Comments, empty lines and malformed rules are skipped.
+
+=head4 load($file)
+
+Maps compiled list from file into memory, replacing current list. Croaks if file can't be read or isn't a compiled list.
+
+=head4 assign($blob)
+
+Copies compiled list from memory, replacing current list. Croaks if blob isn't a compiled list.
+
+=head4 loaded()
+
+=head4 clear()
+
+Unloads list.
+
+=head1 INCREMENTAL PARSING
+
+Panda::URI::Parser parses urls which come in chunks (for example, request targets split across network reads). Parser's state
+machine runs over every chunk as it arrives, so nothing is rescanned at the end, and the result is the same as uri() of the whole
+string.
+
+    my $parser = Panda::URI::Parser->new(VALIDATE, 8192);
+    while (my $chunk = read_more()) {
+        $parser->feed($chunk) or return bad_request(); # too long or invalid
+    }
+    my $uri = $parser->finish;
+
+=head4 new([$flags], [$max_length])
+
+Flags are the same as for uri(). If $max_length is not 0, parser won't buffer more than $max_length bytes.
+
+=head4 feed($chunk)
+
+Returns false and doesn't take the chunk if url would become longer than $max_length or, with VALIDATE flag, if the chunk makes url
+invalid. Once url is invalid, all chunks are rejected until reset().
+
+=head4 finish()
+
+Returns uri object of the class registered for its scheme and resets parser for the next url. Croaks if url is invalid
+(with VALIDATE flag).
+
+=head4 reset([$flags])
+
+=head4 valid()
+
+=head4 error_offset()
+
+Offset of the first invalid char (with VALIDATE flag) or undef.
+
+=head4 length()
+
+Bytes buffered.
+
+=head4 max_length()
+
+=head4 flags()
+
 =head1 C++ INTERFACE
 
 Here and below only short details are explained. For full docs see perl interface docs above.
@@ -402,6 +711,12 @@ Creates empty non-strict uri object.
 
 Creates non-strict uri object from string.
 
+Parsing doesn't copy components: path, query string, fragment and scheme (as well as host and user_info if they have nothing
+to decode) share source's buffer. If source references foreign memory (not owned by string), it is copied once.
+
+With URI::VALIDATE flag throws ParseError (a subclass of URIError) if source is invalid. ParseError has public members 'offset'
+(position of the first invalid char) and 'part' (URIView::part_t of the component it was found in).
+
 =head4 URI (const URI& source)
 
 Creates non-strict uri object from another object (cloning).
@@ -422,6 +737,23 @@ Sets data from another uri object or url string.
 
 =head4 const string& fragment () const
 
+=head4 host_type_t host_type () const
+
+=head4 const in_addr* host_ipv4 () const
+
+=head4 const in6_addr* host_ipv6 () const
+
+=head4 string host_zone () const
+
+Host is classified whenever it changes (see host_type() perl method). Address accessors return NULL if host is not of that type.
+Zone id shares host's buffer. None of them allocate.
+
+=head4 string public_suffix (const PublicSuffix& list = PublicSuffix::instance()) const
+
+=head4 string registrable_domain (const PublicSuffix& list = PublicSuffix::instance()) const
+
+Returned strings share host's buffer and are empty where perl methods return undef.
+
 =head4 uint16_t explicit_port () const
 
 =head4 uint16_t default_port () const
@@ -432,6 +764,23 @@ Sets data from another uri object or url string.
 
 Returns properties of uri.
 
+=head4 int flags () const
+
+Flags uri has been created with.
+
+=head4 char query_delim () const
+
+Query params delimiter according to flags (';' if PARAM_DELIM_SEMICOLON is set, otherwise '&').
+
+=head4 int scheme_index () const
+
+Returns index of uri's scheme in scheme registry or -1 if scheme is not registered. Indexes are small consecutive numbers
+(in order of registration), so they can be used to index arrays of per-scheme data.
+
+=head4 void* scheme_binding () const
+
+Returns data attached to uri's scheme via C<URI::scheme_binding(index, data)> or NULL.
+
 =head4 virtual void assign (const URI& source)
 
 Assign data from another uri. Same as C<URI& operator= (const URI& source)>.
@@ -450,8 +799,8 @@ Returns encoded query string
 
 =head4 Query& query ()
 
-Returns query params as object of class Query (std::multimap<string,string>). Unlike for perl's method, you can change this
-multimap object and changes will take effect for uri object.
+Returns query params as object of class Query (multimap-like container of string pairs). Unlike for perl's method,
+you can change this object and changes will take effect for uri object.
 
 =head4 const Query& query () const
 
@@ -497,9 +846,26 @@ Adds query params from addstr to current query.
 
 Adds query params from addquery to current query.
 
-=head4 const string& param (const string& key) const
+=head4 string param (const string& key) const
+
+Returns value for param with key 'key'. If it's a multiparam, returns first of its values. Returns empty string if there is no
+such param.
+
+If query string hasn't been parsed into Query yet (i.e. query() hasn't been called since query string was set), this method doesn't
+parse it. Instead, query string is scanned for 'key' and only values of matching params get decoded. The same applies to
+find_param(), multiparam() and nparam(). Perl's param(), multiparam() and nparam() use them.
+
+=head4 bool find_param (const string& key, string& val) const
 
-Returns value for param with key 'key'. If it's a multiparam, returns first of its values.
+Same as param() but returns false if there is no such param.
+
+=head4 size_t multiparam (const string& key, std::vector<string>& vals) const
+
+Appends all values of param 'key' to 'vals' and returns the number of values found.
+
+=head4 size_t nparam () const
+
+Returns the number of query params.
 
 =head4 void param (const string& key, const string& val)
 
@@ -517,12 +883,45 @@ Sets param value replacing existing one. If it's a multiparam, replaces just fir
 
 =head4 string to_string (bool relative = false) const
 
+Absolute form is cached and returned as a shared copy of the cache until any component is changed (by setters or via Query object).
+The first call on a just parsed uri compares the result with the source string and keeps the source if they are equal, so that
+the string shares memory with components.
+
 =head4 string relative () const
 
 =head4 bool equals (const URI& uri) const
 
+If both uris have their hashes cached, they are compared first.
+
+=head4 uint64_t hash () const
+
+Hash of components compared by equals() (port is taken into account as port(), so explicit default port doesn't change the hash).
+Cached until uri is changed. With C++11 there is also std::hash<panda::uri::URI> specialization, so uris can be used in
+unordered containers as is.
+
+=head4 void normalize (bool sort_query = false)
+
+=head4 string normalized_string (bool sort_query = false) const
+
 See perl interface docs for methods above.
 
+normalize() only changes (and therefore detaches from shared source buffer) components which are not normalized already.
+normalized_string() writes everything straight into the result string and makes no other allocations (except for sorting
+queries with more than 32 params).
+
+=head4 void resolve (const URI& base)
+
+Resolves current uri as a reference against 'base' in place (RFC 3986 5.2). Components taken from base share its buffers.
+
+=head4 void resolve (const URI& base, const string& ref)
+
+Sets current uri to 'ref' resolved against 'base'. To resolve a lot of references against one base, reuse one uri object for
+the results.
+
+=head4 static size_t remove_dot_segments (char* path, size_t len)
+
+Removes dot segments from path in place as described in RFC 3986 5.2.4. Returns new length.
+
 =head4 void swap (URI& uri)
 
 Swaps content of two uri objects.
@@ -531,13 +930,398 @@ Swaps content of two uri objects.
 
 Creator function type for custom scheme objects.
 
-=head4 static void register_scheme (const string& scheme, const std::type_info* ti, uricreator, uint16_t default_port, bool secure = false)
+=head4 static int register_scheme (const string& scheme, const std::type_info* ti, uricreator, uint16_t default_port, bool secure = false)
+
+Registers new scheme and returns its index. "ti" is a typeinfo for your scheme's class. It's required for URI framework to
+automatically convert scheme names to classes and vice-versa. Scheme names are case-insensitive.
+
+If "ti" and creator are NULL, scheme just gets an index (this is what perl's register_scheme() does for schemes without C++ class),
+such scheme may be registered again with a class later. Registering a scheme with a class twice throws std::invalid_argument.
+
+Scheme lookups are lock-free (built-in schemes are found without even hashing the name), and it's safe to register schemes
+while other threads are parsing urls.
+
+=head4 static int scheme_index (const string& scheme)
+
+Returns index of scheme or -1 if it's not registered.
 
-Registers new scheme. "ti" is a typeinfo for your scheme's class. It's required for URI framework to automatically convert
-scheme names to classes and vice-versa.
+=head4 static void scheme_binding (int index, void* data)
+
+Attaches opaque data to a registered scheme, for language bindings (Panda::URI keeps the perl class to bless to there).
+Data is kept when a scheme is registered again with a class. It may be set while other threads read it, but it's never
+freed, so a previous value must stay valid.
 
 See C<REGISTERING SCHEMAS> for how to.
 
+=head2 panda::uri::URIView
+
+Non-owning parse result for read-only access. Holds offsets of components in the source buffer (which must outlive the view)
+and makes no allocations. Components are returned as is (not decoded) as strings referencing the source buffer.
+
+=head4 URIView (const char* str, size_t len, int flags = 0)
+
+=head4 URIView (const string& str, int flags = 0)
+
+=head4 void parse (const char* str, size_t len, int flags = 0)
+
+Parses url the same way as URI does.
+
+=head4 string scheme () const
+
+=head4 string user_info () const
+
+=head4 string host () const
+
+=head4 string path () const
+
+=head4 string query_string () const
+
+=head4 string fragment () const
+
+=head4 uint16_t explicit_port () const
+
+=head4 uint16_t default_port () const
+
+=head4 uint16_t port () const
+
+=head4 span_t span (part_t part) const
+
+Returns offset and length of component (URIView::SCHEME, USER_INFO, HOST, PORT, PATH, QUERY, FRAGMENT) in the source buffer.
+
+=head4 URI* to_uri () const
+
+Creates strict uri object from view without parsing again (same as C<URI::create(view)>). There are also C<URI (const URIView&)>
+constructor for non-strict objects. Source is copied once and components share that copy.
+
+=head4 bool valid () const
+
+=head4 ssize_t error_offset () const
+
+=head4 part_t error_part () const
+
+With URI::VALIDATE flag parsing stops at the first invalid char. valid() returns false then, error_offset() and error_part()
+tell where the char is. Without the flag view is always valid.
+
+=head4 static const char* part_name (part_t part)
+
+Returns name of component ("scheme", "user_info", "host", "port", "path", "query", "fragment").
+
+=head2 panda::uri::URIParser
+
+Incremental parser for urls which come in chunks (for example, request targets split across network reads). Chunks are appended
+to internal buffer and parser's state machine runs over every chunk as it arrives, keeping its state between calls, so nothing
+is rescanned at the end. The result is the same as one-shot parsing of the whole string, and components of resulting uri share
+parser's buffer.
+
+    URIParser parser(0, 8192);
+    while (...) if (!parser.feed(chunk, chunk_len)) { /* url too long */ }
+    URI* uri = parser.finish();
+
+=head4 URIParser (int flags = 0, size_t max_length = 0)
+
+'flags' are the same as for URI. If 'max_length' is not 0, parser won't buffer more than 'max_length' bytes.
+
+=head4 bool feed (const char* data, size_t len)
+
+=head4 bool feed (const string& data)
+
+Parses next chunk. Returns false (and doesn't take the chunk) if buffered url would become longer than 'max_length'.
+With URI::VALIDATE flag also returns false as soon as the chunk has an invalid char, so that you can drop the connection without
+waiting for the rest of the url. The chunk is not taken either, the error is kept: error_offset() (which may point past the buffered
+data) is reported, further chunks are rejected and finish() throws until reset().
+
+=head4 bool valid () const
+
+=head4 ssize_t error_offset () const
+
+Validation result so far (with URI::VALIDATE flag).
+
+=head4 URI* finish ()
+
+Finishes parsing and creates uri object of the class registered for its scheme (like URI::create()). Parser is reset and is ready
+for the next url. Throws ParseError if url is invalid (with URI::VALIDATE flag).
+
+=head4 void finish (URI& uri)
+
+Same, but sets the result into 'uri'. Throws if 'uri' is strict and scheme doesn't match.
+
+=head4 void reset ()
+
+=head4 void reset (int flags)
+
+Drops buffered data, optionally changing flags.
+
+=head4 size_t length () const
+
+Number of bytes buffered.
+
+=head2 panda::uri::PackedURI
+
+Compact read-only form of uri for keeping millions of urls in memory (crawler frontiers, dedup sets, etc). Encoded url is stored
+once in a single allocation after a header of explicit port, scheme index, flags and lengths of components: 18 bytes, or 28 for
+urls longer than 64K (offsets follow from lengths, as components and delimiters come in fixed order). The object itself is one
+pointer. URI object with its strings and query takes several hundred bytes more.
+
+    std::vector<PackedURI> frontier;
+    frontier.push_back(PackedURI(uri));
+    ...
+    URI* next = frontier.back().to_uri();
+
+=head4 PackedURI (const URI& uri)
+
+=head4 void assign (const URI& uri)
+
+Packs uri. It's serialized straight into the packed buffer, so the result is the same as C<uri.to_string()>.
+
+=head4 string dump () const
+
+=head4 void load (const char* buf, size_t len)
+
+=head4 void load (const string& buf)
+
+Packed data as bytes and back. load() checks that lengths of components agree with the url and its delimiters and throws URIError
+if buffer is truncated or malformed. Scheme index is looked up again, as it depends on order of scheme registration.
+
+=head4 string scheme () const
+
+=head4 string user_info () const
+
+=head4 string host () const
+
+=head4 string path () const
+
+=head4 string query_string () const
+
+=head4 string fragment () const
+
+=head4 string part (URIView::part_t part) const
+
+Components as they are in packed url (not decoded), as strings referencing packed buffer (like URIView returns them),
+so they must not outlive the object.
+
+=head4 uint16_t explicit_port () const
+
+=head4 uint16_t default_port () const
+
+=head4 uint16_t port () const
+
+=head4 bool secure () const
+
+=head4 int scheme_index () const
+
+=head4 const char* data () const
+
+=head4 size_t length () const
+
+=head4 string to_string () const
+
+Packed url itself (to_string() returns a copy).
+
+=head4 size_t bytes () const
+
+Memory used by packed data.
+
+=head4 URIView view () const
+
+Returns view of packed url without parsing it.
+
+=head4 URI* to_uri () const
+
+=head4 void to_uri (URI& uri) const
+
+Converts back to uri without parsing. The first one creates strict object of the class registered for the scheme, like
+URI::create() does.
+
+=head2 panda::uri::InternPool
+
+Bounded pool of distinct strings (see perl's intern()). Interned strings reference pool's memory (string::REF) rather than a
+refcounted buffer, so they're shared between threads without atomic refcounting; in return the pool must outlive all of them
+and never drops entries. Lookups of strings already in pool take no lock, insertions are serialized by a spinlock.
+
+    static InternPool pool(100000);
+    InternPool::current(&pool); // URI::parse() interns hosts, parse_query() interns param names
+
+=head4 InternPool (size_t max_size = 65536, size_t max_len = 255)
+
+=head4 bool intern (string& str)
+
+Replaces C<str> with the pooled copy (adding it if there is room). Returns false if C<str> is empty, too long or the pool is full.
+
+=head4 stats_t stats () const
+
+C<size>, C<bytes>, C<lookups>, C<hits>.
+
+=head4 void reset_stats ()
+
+Resets lookups and hits.
+
+=head4 static InternPool* current ()
+
+=head4 static void current (InternPool* pool)
+
+Pool used by URI, process-wide. NULL (the default) disables interning.
+
+=head2 panda::uri::Arena
+
+Monotonic memory arena for request-scoped uris. While an C<Arena::Scope> is active in a thread, URI objects (of any class) and
+Query objects created in that thread are bound to the arena: their memory comes from it and deleting them frees nothing. All the
+memory is dropped at once at the end of request.
+
+    Arena arena;
+    {
+        Arena::Scope scope(arena);
+        URI* uri = URI::create(request_target);
+        ...
+        delete uri;
+    }
+    arena.clear();
+
+Everything created in a scope must be destroyed (or forgotten) before the arena is cleared. Query storage follows the object rather
+than the scope active at the moment, so uris created outside of scope may be parsed, copied and changed inside it and stay valid
+after clear(). Component strings are allocated as usual, but most of them share the buffer of the source string anyway.
+
+Without an arena, URI objects and Query storage of up to 512 bytes are reused via thread-local free lists, so short-lived uris
+(like perl objects created by uri() and new()) don't go through malloc/free every time. Perl wrappers of uri objects are pooled the
+same way. Free lists are released when their thread exits.
+
+=head4 Arena (size_t block_size = 8192)
+
+=head4 void* allocate (size_t size)
+
+=head4 void clear ()
+
+Frees all the memory except for the first block, which is kept for reuse.
+
+=head4 size_t allocated () const
+
+Bytes given out since the last clear().
+
+=head4 Arena::Scope (Arena& arena)
+
+Makes 'arena' current for this thread until the scope object is destroyed. Scopes may be nested.
+
+=head4 static Arena* current ()
+
+=head4 void* allocate (size_t size, Arena* arena)
+
+=head4 void deallocate (void* ptr)
+
+Memory from 'arena' or, if it's NULL, from free lists / heap. deallocate() accepts memory of any origin.
+
+=head4 template <class T> class Allocator (Arena* arena = NULL)
+
+STL allocator over allocate(size, arena), bound to the arena it was constructed with (Query uses it).
+
+=head2 panda::uri::Router
+
+See L</ROUTER>.
+
+    Router router;
+    int user = router.add("/users/:id");
+    ...
+    RouteMatch m;
+    if (router.match(uri, m) == user) load_user(m.capture(0));
+
+=head4 int add (const string& pattern)
+
+Throws RouterError (a URIError) if pattern is malformed or already added.
+
+=head4 int match (const string& path, RouteMatch& m) const
+
+=head4 int match (const URI& uri, RouteMatch& m) const
+
+Return route id (also stored in m.route) or -1.
+
+=head4 size_t size () const
+
+=head4 const string& pattern (int route) const
+
+=head4 const std::vector<string>& params (int route) const
+
+=head4 void clear ()
+
+=head2 panda::uri::RouteMatch
+
+Keeps matched path (sharing its buffer) and spans of captures, so matching allocates nothing. C<ncaptures> is the number of captures,
+up to MAX_CAPTURES (16).
+
+=head4 string capture (size_t i) const
+
+Decoded capture. If there is nothing to decode, returned string shares the path's buffer.
+
+=head4 string raw (size_t i) const
+
+Capture as it is in the path.
+
+=head4 span_t span (size_t i) const
+
+=head2 panda::uri::PublicSuffix
+
+See L</PUBLIC SUFFIX>. Blob layout is a header, an array of 16-byte nodes (children of every node are contiguous and sorted, so
+they are searched by bisection) and label bytes; it contains no pointers.
+
+    PublicSuffix& psl = PublicSuffix::instance();
+    psl.load("/var/lib/app/psl.bin");
+    string domain = uri.registrable_domain();
+
+=head4 static string compile (const string& list)
+
+=head4 void assign (const string& blob)
+
+=head4 void load (const string& path)
+
+Both throw URIError if data is not a valid compiled list, previously loaded list is kept in that case.
+
+=head4 void clear ()
+
+=head4 bool loaded () const
+
+=head4 size_t bytes () const
+
+=head4 bool find (const char* host, size_t len, result_t& res) const
+
+Low-level lookup. Fills offsets of the public suffix (C<res.suffix>), registrable domain (C<res.domain>, string::npos if host is a
+public suffix itself) and their end (C<res.end>, host length without trailing dot). Returns false if nothing is loaded or host
+has empty labels.
+
+=head4 static PublicSuffix& instance ()
+
+Process-wide list used by URI methods by default and by perl interface. Load it before starting threads.
+
+=head2 panda::uri::Query
+
+Multimap of query params with the API of std::multimap<string,string> (find, equal_range, count, insert, erase, iterators, ...),
+stored in a flat vector of std::pair<string,string>, which is much faster to build, walk and copy for typical queries.
+By default params are sorted by key. Iterators are invalidated by insertions and removals.
+
+Params are copy-on-write: copies of a Query (and so copies of uris, clone(), threads' CLONE) share them until one of the copies
+calls a non-const method, including non-const begin()/end()/find() and friends, which copies params first. So copying costs the same
+regardless of the number of params; to only read params of a shared query, use it through a const reference. Iterators obtained
+before a copy has been made may be invalidated by the first non-const access after it.
+
+A Query takes its storage from the arena active when it's constructed (see C<Arena>). Params held in an arena are shared only
+with copies bound to the same arena, other copies (including those made outside of any scope) get their own params on copying.
+
+=head4 Query (bool keep_order = false)
+
+If 'keep_order' is true, params are kept in the order they have been inserted in, except that params with the same key are
+grouped together at the place of the first of them. Lookups are linear in this mode. URI parses query in this mode if
+QUERY_KEEP_ORDER flag is set.
+
+=head4 void keep_order (bool val)
+
+Switches mode (sorting params if needed).
+
+=head4 void touch ()
+
+Query has a revision counter (C<rev>), which is increased by every change made via its methods. URI and perl wrapper use it to
+know when cached query string, to_string() result and perl's query hash are outdated. Lookups and iteration never change it,
+including ones via non-const iterators, so if you modify params through an iterator, call touch() afterwards.
+
+    Query& q = uri.query();
+    for (Query::iterator it = q.begin(); it != q.end(); ++it) it->second = "x";
+    q.touch();
+
 =head2 panda::uri::URI::http
 
 =head4 http (const string& source, const Query& query, int flags = 0)
@@ -568,7 +1352,13 @@ Does what JavaScript's encodeURIComponent does.
 'unsafe' is an array char[256] where index is char code to be replaced and value is either 0 or the same char code.
 If value is 0 then this char should be replaced with %XX. If value isn't 0, then it is replaced with value code.
 By default the alphabet for query param names and values is used. You can use one of these predefined arrays (in panda::uri::):
-unsafe_scheme, unsafe_uinfo, unsafe_host, unsafe_path, unsafe_path_segment, unsafe_query, unsafe_query_component, unsafe_fragment.
+unsafe_scheme, unsafe_uinfo, unsafe_host, unsafe_ip_literal, unsafe_path, unsafe_path_segment, unsafe_query, unsafe_query_component,
+unsafe_query_component_plus (space is encoded as '+'), unsafe_fragment.
+
+On x86 CPUs with SSSE3 or AVX2 (detected at runtime) runs of chars that pass through as is are found and copied 16/32 bytes at a time.
+This is done for the predefined arrays only (their lookup tables are built at startup), custom arrays are encoded char by char, so
+they may be changed or freed at any time.
+Define PANDA_URI_NO_SIMD when building to disable vector code.
 
 =head4 void encode_uri_component (const char* src, size_t srclen, string& dest, const char* unsafe = unsafe_query_component)
 
@@ -585,13 +1375,52 @@ Does what JavaScript's decodeURIComponent does.
 'dest' must have enough space to hold the result (in worst case = srclen)).
 'destlen' is set to actual resulting string length.
 
-=head4 void decode_uri_component (const char* src, size_t srclen, string& dest)
+=head4 bool decode_uri_component (const char* src, size_t srclen, string& dest)
 
 =head4 void decode_uri_component (const string& src, char* dest, size_t* destlen)
 
-=head4 void decode_uri_component (const string& src, string& dest)
+=head4 bool decode_uri_component (const string& src, string& dest)
 
-String versions.
+String versions. Return false if 'src' had nothing to decode and was just copied.
+
+=head4 size_t find_uri_escape (const char* src, size_t srclen)
+
+Returns the position of the first char that needs decoding ('%' or '+') or 'srclen' if there is nothing to decode.
+Decoding functions use it (vectorized on x86) to copy clean spans as a whole.
+
+=head4 size_t normalize_uri_escapes (const char* src, size_t srclen, char* dest)
+
+Uppercases hex digits of percent-escapes and decodes escaped unreserved chars (RFC 3986 6.2.2). Writes result to dest (which may be
+the same as src) and returns its length, which is never greater than srclen.
+
+=head4 template <class ForwardIterator> void encode_query (ForwardIterator first, ForwardIterator last, string& dest, char delim = '&')
+
+Encodes params from a range of pairs (Query, std::map<string,string>, vector of pairs, etc) straight into query string and appends
+them to dest, separated by delim. The range is walked twice, so that dest's buffer is allocated once.
+
+    std::map<string,string> params;
+    ...
+    string qstr;
+    encode_query(params.begin(), params.end(), qstr);
+    uri.query_string(qstr);
+
+=head4 host_type_t parse_host (const char* host, size_t len, host_info_t& info)
+
+Classifies host as URI keeps it (decoded, IP literal in brackets) and fills C<info> with type, binary address and zone id position.
+
+=head4 const stats_t& stats ()
+
+Returns counters of the current thread (all zeros unless built with C<-DPANDA_URI_STATS>). C<stats_t> is a struct of uint64_t fields:
+C<parse>, C<parse_bytes> (URI::parse() calls and source length), C<to_string>, C<to_string_hits>, C<to_string_bytes> (calls, calls
+served from cache, length of strings built otherwise), C<query_sync>, C<query_sync_hits>, C<parse_query_bytes> (accesses to parsed
+query, when it was up to date, length of query strings parsed otherwise), C<qstr_sync>, C<qstr_sync_hits>, C<qstr_sync_bytes>
+(the same for query string), C<query_hv_sync>, C<query_hv_sync_hits> (perl's query hash), C<encode>, C<encode_bytes>, C<decode>,
+C<decode_skips>, C<decode_bytes> (encoding/decoding calls including internal ones, decode calls which had nothing to decode, input
+bytes).
+
+=head4 void reset_stats ()
+
+Sets counters of the current thread to zero.
 
 =head1 REGISTERING SCHEMAS
 
@@ -687,6 +1516,14 @@ Typemap for input/output any URI objects.
 
 Typemaps for input/output strict uris.
 
+=head4 Router*
+
+Typemap for Panda::URI::Router objects.
+
+=head4 URIParser*
+
+Typemap for Panda::URI::Parser objects.
+
 =head4 URIx*
 
 Output-only typemap for autodetecting strict uri type and setting right perl class to bless to. You must not define a 'CLASS' variable.
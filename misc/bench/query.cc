@@ -0,0 +1,110 @@
+// Benchmark of Query (flat vector) against the former std::multimap based Query.
+// Build (with panda-lib headers and library available):
+//   g++ -O2 -Isrc misc/bench/query.cc src/panda/uri/*.cc -lpanda-lib -o bench_query && ./bench_query
+#include <map>
+#include <cstdio>
+#include <sys/time.h>
+#include <panda/uri.h>
+
+using namespace panda::uri;
+using panda::string;
+
+typedef std::multimap<string,string> LegacyQuery;
+
+static const char* queries[] = {
+    "a=1",
+    "q=perl+xs&ie=utf-8&oe=utf-8&client=firefox",
+    "utm_source=newsletter&utm_medium=email&utm_campaign=spring&utm_term=shoes&utm_content=banner&id=12345&ref=home",
+    "p1=v1&p2=v2&p3=a%20b&p2=v2v2&=empty&empty=&x=1&y=2&z=3&sort=desc&page=10&per_page=50&filter%5Bcolor%5D=red&lang=ru",
+    NULL
+};
+
+static double now () {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void legacy_parse (const string& qstr, LegacyQuery& query) {
+    query.clear();
+    const char* str = qstr.data();
+    size_t len = qstr.length(), kstart = 0, vstart = 0;
+    bool has_val = false;
+    for (size_t i = 0; i <= len; ++i) {
+        if (i == len || str[i] == '&') {
+            size_t klen = (has_val ? vstart - 1 : i) - kstart;
+            string key, val;
+            decode_uri_component(qstr, kstart, klen, key);
+            if (has_val) decode_uri_component(qstr, vstart, i - vstart, val);
+            query.insert(LegacyQuery::value_type(key, val));
+            kstart = i + 1;
+            has_val = false;
+        }
+        else if (str[i] == '=' && !has_val) {
+            has_val = true;
+            vstart = i + 1;
+        }
+    }
+}
+
+static void legacy_compile (const LegacyQuery& query, string& dest) {
+    size_t bufsize = 0;
+    for (LegacyQuery::const_iterator it = query.begin(); it != query.end(); ++it)
+        bufsize += (it->first.length() + it->second.length())*3 + 2;
+    dest.clear();
+    dest.reserve(bufsize);
+    char* bufp = dest.buf();
+    char* ptr = bufp;
+    size_t len;
+    for (LegacyQuery::const_iterator it = query.begin(); it != query.end(); ++it) {
+        if (it != query.begin()) *ptr++ = '&';
+        encode_uri_component(it->first, ptr, &len);
+        ptr += len;
+        *ptr++ = '=';
+        encode_uri_component(it->second, ptr, &len);
+        ptr += len;
+    }
+    dest.resize(ptr - bufp);
+}
+
+static void report (const char* name, const char* q, double elapsed, int iters) {
+    printf("%-10s %8.1f ns/op  (%.40s)\n", name, elapsed / iters * 1e9, q);
+}
+
+int main () {
+    const int iters = 200000;
+    size_t sink = 0;
+    for (const char** qp = queries; *qp; ++qp) {
+        string qstr(*qp);
+        URI uri("http://example.com/?" + qstr);
+        LegacyQuery lq;
+        string out;
+
+        double t = now();
+        for (int i = 0; i < iters; ++i) { uri.query_string(qstr); sink += uri.query().size(); }
+        report("parse", *qp, now() - t, iters);
+        t = now();
+        for (int i = 0; i < iters; ++i) { legacy_parse(qstr, lq); sink += lq.size(); }
+        report("  multimap", *qp, now() - t, iters);
+
+        t = now();
+        for (int i = 0; i < iters; ++i) { uri.query().insert("x", "y"); sink += uri.query_string().length(); uri.query().erase("x"); }
+        report("compile", *qp, now() - t, iters);
+        t = now();
+        for (int i = 0; i < iters; ++i) { lq.insert(LegacyQuery::value_type("x", "y")); legacy_compile(lq, out); sink += out.length(); lq.erase("x"); }
+        report("  multimap", *qp, now() - t, iters);
+
+        t = now();
+        for (int i = 0; i < iters; ++i) sink += uri.param("p2").length() + uri.param("nonexistent").length();
+        report("param", *qp, now() - t, iters);
+        t = now();
+        for (int i = 0; i < iters; ++i) {
+            LegacyQuery::const_iterator it = lq.find("p2");
+            if (it != lq.end()) sink += it->second.length();
+            it = lq.find("nonexistent");
+            if (it != lq.end()) sink += it->second.length();
+        }
+        report("  multimap", *qp, now() - t, iters);
+    }
+    return sink == 0;
+}
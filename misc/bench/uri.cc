@@ -0,0 +1,257 @@
+// Benchmark suite of the C++ core over bundled corpora (misc/bench/corpus/*.txt, one url per line, generated once and kept
+// in the repo, so that numbers are comparable between revisions). For every operation and corpus prints ns/op, MB/s of input
+// urls and allocations/op (operator new and, with glibc, malloc calls are counted).
+// Build (with panda-lib headers and library available):
+//   g++ -O2 -Isrc misc/bench/uri.cc src/panda/uri/*.cc -lpanda-lib -o bench_uri
+//   ./bench_uri [corpus_dir=misc/bench/corpus] [operation_filter]
+#include <new>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <panda/uri/all.h>
+
+using namespace panda::uri;
+using panda::string;
+
+static unsigned long allocs;
+
+#ifdef __GLIBC__
+// operator new goes to the real malloc, so that its calls are not counted twice
+extern "C" void* __libc_malloc (size_t);
+extern "C" void  __libc_free   (void*);
+extern "C" void* malloc (size_t size) { ++allocs; return __libc_malloc(size); }
+#  define COUNTED_NEW(size) (++allocs, __libc_malloc(size))
+#  define COUNTED_DELETE(p) __libc_free(p)
+#else
+#  define COUNTED_NEW(size) (++allocs, malloc(size))
+#  define COUNTED_DELETE(p) free(p)
+#endif
+
+#if __cplusplus < 201103L
+#  define THROW_BAD_ALLOC throw(std::bad_alloc)
+#  define THROW_NONE      throw()
+#else
+#  define THROW_BAD_ALLOC
+#  define THROW_NONE      noexcept
+#endif
+
+void* operator new (size_t size) THROW_BAD_ALLOC {
+    void* p = COUNTED_NEW(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void  operator delete   (void* p) THROW_NONE                   { COUNTED_DELETE(p); }
+void* operator new[]    (size_t size) THROW_BAD_ALLOC          { return operator new(size); }
+void  operator delete[] (void* p) THROW_NONE                   { COUNTED_DELETE(p); }
+#ifdef __cpp_sized_deallocation
+void  operator delete   (void* p, size_t) THROW_NONE           { COUNTED_DELETE(p); }
+void  operator delete[] (void* p, size_t) THROW_NONE           { COUNTED_DELETE(p); }
+#endif
+
+static double now () {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+struct Corpus {
+    std::string         name;
+    std::vector<string> urls;
+    size_t              bytes;
+};
+
+static bool load (const std::string& dir, const char* name, Corpus& corpus) {
+    std::string path = dir + "/" + name + ".txt";
+    FILE* fh = fopen(path.c_str(), "r");
+    if (!fh) {
+        fprintf(stderr, "can't open %s\n", path.c_str());
+        return false;
+    }
+    corpus.name  = name;
+    corpus.bytes = 0;
+    char line[65536];
+    while (fgets(line, sizeof(line), fh)) {
+        size_t len = strlen(line);
+        while (len && (line[len-1] == '\n' || line[len-1] == '\r')) --len;
+        if (!len) continue;
+        corpus.urls.push_back(string(line, len, string::COPY));
+        corpus.bytes += len;
+    }
+    fclose(fh);
+    return true;
+}
+
+/* Every operation gets a corpus and prepared uris (parsed from the corpus), runs over all of them once per call and returns
+ * something depending on the result, so that the work can't be optimized away */
+typedef size_t (*op_t) (const Corpus& corpus, std::vector<URI>& uris);
+
+static size_t op_parse (const Corpus& c, std::vector<URI>&) {
+    size_t ret = 0;
+    for (size_t i = 0; i < c.urls.size(); ++i) {
+        URI uri(c.urls[i]);
+        ret += uri.path().length();
+    }
+    return ret;
+}
+
+static size_t op_parse_reuse (const Corpus& c, std::vector<URI>& uris) {
+    size_t ret = 0;
+    URI& uri = uris[0];
+    for (size_t i = 0; i < c.urls.size(); ++i) {
+        uri.assign(c.urls[i]);
+        ret += uri.path().length();
+    }
+    return ret;
+}
+
+static size_t op_create (const Corpus& c, std::vector<URI>&) {
+    size_t ret = 0;
+    for (size_t i = 0; i < c.urls.size(); ++i) {
+        URI* uri = URI::create(c.urls[i]);
+        ret += uri->path().length();
+        delete uri;
+    }
+    return ret;
+}
+
+static size_t op_create_arena (const Corpus& c, std::vector<URI>&) {
+    static Arena arena;
+    size_t ret = 0;
+    {
+        Arena::Scope scope(arena);
+        for (size_t i = 0; i < c.urls.size(); ++i) {
+            URI* uri = URI::create(c.urls[i]);
+            ret += uri->query().size();
+            delete uri;
+        }
+    }
+    arena.clear();
+    return ret;
+}
+
+static size_t op_view (const Corpus& c, std::vector<URI>&) {
+    size_t ret = 0;
+    for (size_t i = 0; i < c.urls.size(); ++i) ret += URIView(c.urls[i]).span(URIView::PATH).length;
+    return ret;
+}
+
+static size_t op_to_string (const Corpus&, std::vector<URI>& uris) {
+    size_t ret = 0;
+    for (size_t i = 0; i < uris.size(); ++i) {
+        uris[i].port(uris[i].explicit_port()); // drop cached string
+        ret += uris[i].to_string().length();
+    }
+    return ret;
+}
+
+static size_t op_to_string_cached (const Corpus&, std::vector<URI>& uris) {
+    size_t ret = 0;
+    for (size_t i = 0; i < uris.size(); ++i) ret += uris[i].to_string().length();
+    return ret;
+}
+
+static size_t op_parse_query (const Corpus&, std::vector<URI>& uris) {
+    size_t ret = 0;
+    for (size_t i = 0; i < uris.size(); ++i) {
+        URI& uri = uris[i];
+        uri.query_string(uri.query_string()); // mark query as not parsed
+        ret += uri.query().size();
+    }
+    return ret;
+}
+
+static size_t op_compile_query (const Corpus&, std::vector<URI>& uris) {
+    size_t ret = 0;
+    for (size_t i = 0; i < uris.size(); ++i) {
+        URI& uri = uris[i];
+        uri.query().touch(); // query string must be compiled again
+        ret += uri.query_string().length();
+    }
+    return ret;
+}
+
+static size_t op_path_segments (const Corpus&, std::vector<URI>& uris) {
+    size_t ret = 0;
+    for (size_t i = 0; i < uris.size(); ++i) ret += uris[i].path_segments().size();
+    return ret;
+}
+
+static size_t op_encode (const Corpus& c, std::vector<URI>&) {
+    size_t ret = 0;
+    string buf;
+    for (size_t i = 0; i < c.urls.size(); ++i) {
+        encode_uri_component(c.urls[i], buf);
+        ret += buf.length();
+    }
+    return ret;
+}
+
+static size_t op_decode (const Corpus& c, std::vector<URI>&) {
+    size_t ret = 0;
+    string buf;
+    for (size_t i = 0; i < c.urls.size(); ++i) {
+        decode_uri_component(c.urls[i], buf);
+        ret += buf.length();
+    }
+    return ret;
+}
+
+struct Op {
+    const char* name;
+    op_t        func;
+};
+
+static const Op ops[] = {
+    {"parse",                op_parse},
+    {"parse_reuse",          op_parse_reuse},
+    {"create",               op_create},
+    {"create_arena",         op_create_arena},
+    {"view",                 op_view},
+    {"to_string",            op_to_string},
+    {"to_string_cached",     op_to_string_cached},
+    {"parse_query",          op_parse_query},
+    {"compile_query",        op_compile_query},
+    {"path_segments",        op_path_segments},
+    {"encode_uri_component", op_encode},
+    {"decode_uri_component", op_decode},
+    {NULL, NULL}
+};
+
+static const char* corpora[] = {"short", "tracking", "encoded", "ipv6", NULL};
+
+int main (int argc, char** argv) {
+    std::string dir    = argc > 1 ? argv[1] : "misc/bench/corpus";
+    const char* filter = argc > 2 ? argv[2] : NULL;
+
+    printf("%-22s %-10s %12s %10s %12s\n", "operation", "corpus", "ns/op", "MB/s", "allocs/op");
+    volatile size_t sink = 0;
+    for (const char** name = corpora; *name; ++name) {
+        Corpus corpus;
+        if (!load(dir, *name, corpus) || corpus.urls.empty()) return 1;
+
+        for (const Op* op = ops; op->name; ++op) {
+            if (filter && !strstr(op->name, filter)) continue;
+            std::vector<URI> uris;
+            uris.reserve(corpus.urls.size());
+            for (size_t i = 0; i < corpus.urls.size(); ++i) uris.push_back(URI(corpus.urls[i]));
+
+            sink += op->func(corpus, uris); // warm up
+
+            size_t rounds = 0;
+            unsigned long start_allocs = allocs;
+            double start = now(), elapsed;
+            do {
+                sink += op->func(corpus, uris);
+                ++rounds;
+            } while ((elapsed = now() - start) < 0.5);
+
+            double nops = (double)rounds * corpus.urls.size();
+            printf("%-22s %-10s %12.1f %10.1f %12.2f\n", op->name, corpus.name.c_str(), elapsed * 1e9 / nops,
+                   rounds * corpus.bytes / elapsed / 1e6, (allocs - start_allocs) / nops);
+        }
+    }
+    return sink == 0xDEADBEEF;
+}
@@ -0,0 +1,147 @@
+#include <cstdlib>
+#include <pthread.h>
+#include <panda/uri/Arena.h>
+
+namespace panda { namespace uri {
+
+static const size_t ALIGN = 16;
+
+static inline size_t align (size_t size) { return (size + ALIGN - 1) & ~(ALIGN - 1); }
+
+__thread Arena* Arena::_current;
+
+void* Arena::allocate (size_t size) {
+    size = align(size);
+    if ((size_t)(_end - _ptr) < size) {
+        // the rest of current block is wasted, it's fine for small objects which arena is for
+        size_t bsize = size + align(sizeof(block_t));
+        if (bsize < _block_size) bsize = _block_size;
+        block_t* block = (block_t*)malloc(bsize);
+        if (!block) throw std::bad_alloc();
+        block->size = bsize;
+        block->next = _blocks;
+        _blocks = block;
+        _ptr = (char*)block + align(sizeof(block_t));
+        _end = (char*)block + bsize;
+    }
+    void* ret = _ptr;
+    _ptr += size;
+    _allocated += size;
+    return ret;
+}
+
+void Arena::clear () {
+    if (!_blocks) return;
+    block_t* keep = _blocks;
+    while (keep->next) { // the last one is the first allocated
+        block_t* block = keep;
+        keep = keep->next;
+        free(block);
+    }
+    _blocks = keep;
+    _ptr = (char*)keep + align(sizeof(block_t));
+    _end = (char*)keep + keep->size;
+    _allocated = 0;
+}
+
+Arena::~Arena () {
+    while (_blocks) {
+        block_t* block = _blocks;
+        _blocks = block->next;
+        free(block);
+    }
+}
+
+/* Every block carries a header before the memory given out, which tells where it came from: arena, free list of its size class
+ * or malloc. Free lists are thread-local and limited in length, so that memory freed after a burst goes back to malloc. */
+union header_t {
+    uint32_t kind;
+    char     pad[ALIGN];
+};
+
+enum {
+    KIND_ARENA  = 0,
+    KIND_MALLOC = 1,
+    KIND_POOL   = 2  // + size class
+};
+
+static const size_t POOL_CLASSES  = 32;   // size classes of ALIGN bytes, up to 512 bytes
+static const size_t POOL_MAX_FREE = 64;   // max free blocks kept per class
+
+struct free_block_t { free_block_t* next; };
+
+static __thread free_block_t* free_lists[POOL_CLASSES];
+static __thread uint32_t      free_counts[POOL_CLASSES];
+
+void* pool_allocate (size_t size) {
+    size_t cls = (size + ALIGN - 1) / ALIGN;
+    header_t* h;
+    if (cls && cls <= POOL_CLASSES) {
+        --cls;
+        if (free_block_t* fb = free_lists[cls]) {
+            free_lists[cls] = fb->next;
+            --free_counts[cls];
+            h = (header_t*)fb;
+        }
+        else if (!(h = (header_t*)malloc(sizeof(header_t) + (cls + 1) * ALIGN))) throw std::bad_alloc();
+        h->kind = KIND_POOL + cls;
+    }
+    else {
+        if (!(h = (header_t*)malloc(sizeof(header_t) + size))) throw std::bad_alloc();
+        h->kind = KIND_MALLOC;
+    }
+    return h + 1;
+}
+
+void* allocate (size_t size, Arena* arena) {
+    if (!arena) return pool_allocate(size);
+    header_t* h = (header_t*)arena->allocate(sizeof(header_t) + size);
+    h->kind = KIND_ARENA;
+    return h + 1;
+}
+
+void* allocate (size_t size) { return allocate(size, Arena::current()); }
+
+// free lists of a thread are given back to malloc when it exits (via destructor of a pthread key set by the thread's first push)
+static pthread_key_t  free_lists_key;
+static pthread_once_t free_lists_once = PTHREAD_ONCE_INIT;
+static __thread bool  free_lists_registered;
+
+static void release_free_lists (void*) {
+    for (size_t cls = 0; cls < POOL_CLASSES; ++cls) {
+        while (free_block_t* fb = free_lists[cls]) {
+            free_lists[cls] = fb->next;
+            free(fb);
+        }
+        free_counts[cls] = 0;
+    }
+    free_lists_registered = false; // other destructors may still free something, it will register again
+}
+
+static void create_free_lists_key () { pthread_key_create(&free_lists_key, release_free_lists); }
+
+void deallocate (void* ptr) {
+    if (!ptr) return;
+    header_t* h = (header_t*)ptr - 1;
+    if (h->kind == KIND_ARENA) return;
+    if (h->kind == KIND_MALLOC) {
+        free(h);
+        return;
+    }
+    size_t cls = h->kind - KIND_POOL;
+    if (free_counts[cls] >= POOL_MAX_FREE) {
+        free(h);
+        return;
+    }
+    if (!free_lists_registered) {
+        pthread_once(&free_lists_once, create_free_lists_key);
+        pthread_setspecific(free_lists_key, (void*)1);
+        free_lists_registered = true;
+    }
+    free_block_t* fb = (free_block_t*)h;
+    fb->next = free_lists[cls];
+    free_lists[cls] = fb;
+    ++free_counts[cls];
+}
+
+}}
@@ -0,0 +1,107 @@
+#pragma once
+#include <new>
+#include <cstddef>
+#include <stdint.h>
+
+namespace panda { namespace uri {
+
+/* Monotonic memory arena for request-scoped uris. While an Arena::Scope is active in a thread, URI objects (of any class) and
+ * Query objects created in that thread are bound to the arena: their memory comes from it and deleting them doesn't free anything,
+ * all the memory is dropped at once by clear() or arena's destructor. Objects created in a scope must be destroyed (or just
+ * forgotten) before the arena is cleared. Query storage follows the object it belongs to rather than the scope active at the
+ * moment, so uris created outside of scope may be used inside it freely. Component strings are not affected, but most of them
+ * share the one buffer of the source string.
+ *
+ *     Arena arena;
+ *     {
+ *         Arena::Scope scope(arena);
+ *         URI* uri = URI::create(request_target);
+ *         ...
+ *         delete uri; // frees nothing, memory goes back with arena.clear()
+ *     }
+ *     arena.clear(); // at the end of request
+ */
+class Arena {
+public:
+    explicit Arena (size_t block_size = 8192) : _blocks(NULL), _ptr(NULL), _end(NULL), _block_size(block_size), _allocated(0) {}
+
+    void*  allocate  (size_t size);
+    void   clear     ();                               // frees all the memory except for the first block, which is reused
+    size_t allocated () const { return _allocated; } // bytes given out since the last clear()
+
+    ~Arena ();
+
+    class Scope {
+    public:
+        explicit Scope (Arena& arena) : _prev(_current) { _current = &arena; }
+        ~Scope () { _current = _prev; }
+    private:
+        Arena* _prev;
+        Scope (const Scope&);
+        Scope& operator= (const Scope&);
+    };
+
+    static Arena* current () { return _current; }
+
+private:
+    struct block_t {
+        block_t* next;
+        size_t   size;
+    };
+
+    block_t* _blocks;
+    char*    _ptr;
+    char*    _end;
+    size_t   _block_size;
+    size_t   _allocated;
+
+    static __thread Arena* _current;
+
+    Arena (const Arena&);
+    Arena& operator= (const Arena&);
+};
+
+/* Memory for URI objects and Query storage. It comes from the given arena or, without one, small blocks are reused via thread-local
+ * free lists (so that short-lived uris don't go through malloc/free every time; lists are freed when the thread exits) and big
+ * ones are malloc'ed. deallocate() knows where the memory came from. */
+void* allocate      (size_t size, Arena* arena);
+void* allocate      (size_t size);      // from the current arena if there is an active Arena::Scope
+void* pool_allocate (size_t size);      // never from arena (for objects which may outlive any scope)
+void  deallocate    (void* ptr);
+
+/* STL allocator over allocate()/deallocate() bound to an arena (or to none) when constructed, so that a container keeps using the
+ * memory of its owner whatever scope is active when it grows. Copies of the allocator are bound to the same arena. */
+template <class T>
+class Allocator {
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef size_t         size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <class U> struct rebind { typedef Allocator<U> other; };
+
+    explicit Allocator (Arena* arena = NULL) : arena(arena) {}
+    template <class U> Allocator (const Allocator<U>& a) : arena(a.arena) {}
+
+    pointer       address (reference x)       const { return &x; }
+    const_pointer address (const_reference x) const { return &x; }
+
+    pointer allocate   (size_type n, const void* = 0) { return static_cast<pointer>(panda::uri::allocate(n * sizeof(T), arena)); }
+    void    deallocate (pointer p, size_type)        { panda::uri::deallocate(p); }
+
+    size_type max_size () const { return size_t(-1) / sizeof(T); }
+
+    void construct (pointer p, const T& val) { new ((void*)p) T(val); }
+    void destroy   (pointer p)               { p->~T(); }
+
+    Arena* arena;
+};
+
+template <class T, class U> inline bool operator== (const Allocator<T>& a, const Allocator<U>& b) { return a.arena == b.arena; }
+template <class T, class U> inline bool operator!= (const Allocator<T>& a, const Allocator<U>& b) { return a.arena != b.arena; }
+
+}}
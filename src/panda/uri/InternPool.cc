@@ -0,0 +1,108 @@
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <panda/lib.h>
+#include <panda/uri/InternPool.h>
+
+namespace panda { namespace uri {
+
+using panda::lib::string_hash;
+
+InternPool* volatile InternPool::_current = NULL;
+
+namespace {
+    struct spin_guard_t {
+        volatile int& lock;
+        spin_guard_t (volatile int& lock) : lock(lock) { while (__sync_lock_test_and_set(&lock, 1)) {} }
+        ~spin_guard_t () { __sync_lock_release(&lock); }
+    };
+}
+
+InternPool::InternPool (size_t max_size, size_t max_len) :
+    _arena(16384), _table(_new_table(64)), _size(0), _max_size(max_size), _max_len(max_len), _lookups(0), _hits(0), _lock(0)
+{}
+
+InternPool::~InternPool () {
+    for (size_t i = 0; i < _old_tables.size(); ++i) free(_old_tables[i]);
+    free(_table);
+}
+
+InternPool::table_t* InternPool::_new_table (size_t size) {
+    table_t* table = (table_t*)calloc(1, sizeof(table_t) + (size - 1) * sizeof(table->slots[0]));
+    if (!table) throw std::bad_alloc();
+    table->mask = size - 1;
+    return table;
+}
+
+// slot with this string or the empty slot where it should go
+const InternPool::entry_t* volatile* InternPool::_slot (table_t* table, const char* str, size_t len, uint32_t hash) {
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+        const entry_t* e = table->slots[i];
+        if (!e || (e->hash == hash && e->len == len && !memcmp(e->str(), str, len))) return &table->slots[i];
+    }
+}
+
+void InternPool::_grow () {
+    table_t* old   = _table;
+    table_t* table = _new_table((old->mask + 1) * 2);
+    for (size_t i = 0; i <= old->mask; ++i) if (const entry_t* e = old->slots[i]) *_slot(table, e->str(), e->len, e->hash) = e;
+    _old_tables.push_back(old);
+    __sync_synchronize();
+    _table = table;
+}
+
+bool InternPool::intern (string& str) {
+    size_t len = str.length();
+    if (!len || len > _max_len) return false;
+    uint32_t hash = string_hash(str.data(), len);
+    __sync_add_and_fetch(&_lookups, 1);
+
+    // entries are published after they're filled, so a non-empty slot may be read without lock
+    if (const entry_t* e = *_slot(_table, str.data(), len, hash)) {
+        __sync_add_and_fetch(&_hits, 1);
+        if (str.data() != e->str()) str = string(e->str(), len, string::REF);
+        return true;
+    }
+
+    spin_guard_t guard(_lock);
+    const entry_t* volatile* slot = _slot(_table, str.data(), len, hash); // may have been added or table grown meanwhile
+    if (const entry_t* e = *slot) {
+        __sync_add_and_fetch(&_hits, 1);
+        str = string(e->str(), len, string::REF);
+        return true;
+    }
+    if (_size >= _max_size) return false;
+
+    if ((_size + 1) * 2 > _table->mask + 1) {
+        _grow();
+        slot = _slot(_table, str.data(), len, hash);
+    }
+    entry_t* e = (entry_t*)_arena.allocate(sizeof(entry_t) + len + 1);
+    e->hash = hash;
+    e->len  = len;
+    char* p = (char*)e->str();
+    memcpy(p, str.data(), len);
+    p[len] = 0;
+    __sync_synchronize();
+    *slot = e;
+    ++_size;
+    str = string(p, len, string::REF);
+    return true;
+}
+
+InternPool::stats_t InternPool::stats () const {
+    spin_guard_t guard(_lock);
+    stats_t ret;
+    ret.size    = _size;
+    ret.bytes   = _arena.allocated() + (_table->mask + 1) * sizeof(_table->slots[0]);
+    ret.lookups = _lookups;
+    ret.hits    = _hits;
+    return ret;
+}
+
+void InternPool::reset_stats () {
+    spin_guard_t guard(_lock);
+    _lookups = _hits = 0;
+}
+
+}}
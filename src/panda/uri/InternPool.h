@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <panda/string.h>
+#include <panda/uri/Arena.h>
+
+namespace panda { namespace uri {
+
+using panda::string;
+
+/* Pool of distinct strings which repeat across many uris. While a pool is installed with InternPool::current(pool), URI::parse()
+ * interns hosts and parse_query() interns param names. Interned strings reference pool's memory (string::REF), so equal values share
+ * one buffer, copying them between threads touches no refcounters and URI::equals() resolves them by comparing pointers.
+ * Entries are never removed, instead the pool is bounded: it keeps up to 'max_size' strings of up to 'max_len' bytes, other values
+ * are left as they are. Strings given out stay valid as long as the pool lives, so it is usually a process-wide object installed at
+ * startup and never destroyed. All methods are thread-safe. Lookups of strings already in pool take no lock (the table only grows and
+ * entries are never removed, so it's published by a pointer), adding strings and growing the table is serialized by a spinlock. */
+class InternPool {
+public:
+    struct stats_t {
+        size_t   size;    // distinct strings in pool
+        size_t   bytes;   // memory they take
+        uint64_t lookups; // intern() calls for suitable strings
+        uint64_t hits;    // when the value was already in pool
+    };
+
+    explicit InternPool (size_t max_size = 65536, size_t max_len = 255);
+    ~InternPool ();
+
+    // replaces 'str' with the pooled copy, adding it if there is room; returns false if 'str' is left untouched
+    bool intern (string& str);
+
+    stats_t stats       () const;
+    void    reset_stats ();
+    size_t  max_size    () const { return _max_size; }
+    size_t  max_len     () const { return _max_len; }
+
+    static InternPool* current ()                 { return _current; }
+    static void        current (InternPool* pool) { _current = pool; } // NULL disables interning
+
+private:
+    // kept in arena right before string's bytes, so a slot is one pointer which is published atomically
+    struct entry_t {
+        uint32_t hash;
+        uint32_t len;
+        const char* str () const { return (const char*)(this + 1); }
+    };
+
+    // open addressing, size is a power of 2 and at least twice the number of entries
+    struct table_t {
+        size_t                  mask;
+        const entry_t* volatile slots[1];
+    };
+
+    Arena                  _arena;
+    table_t* volatile      _table;
+    std::vector<table_t*>  _old_tables; // readers may still be probing them
+    size_t                 _size;
+    size_t                 _max_size;
+    size_t                 _max_len;
+    volatile uint64_t      _lookups;
+    volatile uint64_t      _hits;
+    mutable volatile int   _lock;
+
+    static InternPool* volatile _current;
+
+    static table_t* _new_table (size_t size);
+    static const entry_t* volatile* _slot (table_t* table, const char* str, size_t len, uint32_t hash);
+    void _grow ();
+
+    InternPool (const InternPool&);
+    InternPool& operator= (const InternPool&);
+};
+
+}}
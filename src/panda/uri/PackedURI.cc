@@ -0,0 +1,232 @@
+#include <new>
+#include <cstdlib>
+#include <panda/uri/PackedURI.h>
+
+namespace panda { namespace uri {
+
+static inline size_t print_port (uint16_t port, char* p) {
+    char digits[5];
+    size_t n = 0;
+    for (; port; port /= 10) digits[n++] = '0' + port % 10;
+    for (size_t i = 0; i < n; ++i) p[i] = digits[n-1-i];
+    return n;
+}
+
+void PackedURI::assign (const URI& uri) {
+    const string& scheme = uri.scheme();
+    const string& uinfo  = uri.user_info();
+    const string& host   = uri.host();
+    const string& path   = uri.path();
+    const string& qstr   = uri.query_string();
+    const string& frag   = uri.fragment();
+
+    // the same layout as URI::to_string() makes, but written straight into the packed buffer, after room for wide lengths
+    size_t cap = scheme.length() + 3 + uinfo.length()*3 + 1 + host.length()*3 + 6 + path.length() + qstr.length() + 1 + frag.length() + 1;
+    data_t* d = (data_t*)malloc(sizeof(data_t) + LENS * sizeof(uint32_t) + cap);
+    if (!d) throw std::bad_alloc();
+    char*    buf = (char*)(d + 1) + LENS * sizeof(uint32_t);
+    char*    p   = buf;
+    uint32_t lens[LENS] = {0};
+    uint16_t port = uri.explicit_port();
+
+    if (scheme.length()) {
+        memcpy(p, scheme.data(), scheme.length());
+        p += lens[0] = scheme.length();
+        *p++ = ':';
+    }
+    if (host.length()) {
+        *p++ = '/';
+        *p++ = '/';
+        size_t len;
+        if (uinfo.length()) {
+            encode_uri_component(uinfo.data(), uinfo.length(), p, &len, unsafe_uinfo);
+            p += lens[1] = len;
+            *p++ = '@';
+        }
+        bool ip_literal = host[0] == '[' && host[host.length()-1] == ']';
+        encode_uri_component(host.data(), host.length(), p, &len, ip_literal ? unsafe_ip_literal : unsafe_host);
+        p += lens[2] = len;
+        if (port) {
+            *p++ = ':';
+            p += print_port(port, p);
+        }
+    }
+
+    if (path.length()) memcpy(p, path.data(), path.length());
+    p += lens[3] = path.length();
+
+    if (qstr.length()) {
+        *p++ = '?';
+        memcpy(p, qstr.data(), qstr.length());
+        p += lens[4] = qstr.length();
+    }
+
+    if (frag.length()) {
+        *p++ = '#';
+        memcpy(p, frag.data(), frag.length());
+        p += frag.length();
+    }
+
+    d->len          = p - buf;
+    d->port         = port;
+    d->scheme_index = uri.scheme_index();
+    d->flags        = uri._flags;
+
+    char* lensp = (char*)(d + 1);
+    if (d->len > 0xFFFF) memcpy(lensp, lens, sizeof(lens));
+    else {
+        uint16_t short_lens[LENS];
+        for (int i = 0; i < LENS; ++i) short_lens[i] = lens[i];
+        memcpy(lensp, short_lens, sizeof(short_lens));
+        memmove(lensp + sizeof(short_lens), buf, d->len);
+    }
+
+    size_t size = sizeof(data_t) + lens_size(d->len) + d->len;
+    if (size < sizeof(data_t) + LENS * sizeof(uint32_t) + cap) { // give the unused part back, shrinking is done in place by allocators
+        data_t* shrunk = (data_t*)realloc(d, size);
+        if (shrunk) d = shrunk;
+    }
+
+    clear();
+    _data = d;
+}
+
+void PackedURI::assign (const PackedURI& source) {
+    if (!source._data) {
+        clear();
+        return;
+    }
+    size_t size = source.bytes();
+    data_t* d = (data_t*)malloc(size);
+    if (!d) throw std::bad_alloc();
+    memcpy(d, source._data, size);
+    clear();
+    _data = d;
+}
+
+void PackedURI::load (const char* buf, size_t len) {
+    static const char* errmsg = "PackedURI: truncated or malformed buffer";
+    data_t hdr;
+    if (len < sizeof(hdr)) throw URIError(errmsg);
+    memcpy(&hdr, buf, sizeof(hdr)); // buffer may be unaligned
+    size_t lsize = lens_size(hdr.len);
+    if (len != sizeof(hdr) + lsize + hdr.len) throw URIError(errmsg);
+
+    uint32_t lens[LENS];
+    if (lsize == sizeof(lens)) memcpy(lens, buf + sizeof(hdr), sizeof(lens));
+    else {
+        uint16_t short_lens[LENS];
+        memcpy(short_lens, buf + sizeof(hdr), sizeof(short_lens));
+        for (int i = 0; i < LENS; ++i) lens[i] = short_lens[i];
+    }
+    const char* url = buf + sizeof(hdr) + lsize;
+    span_t spans[URIView::PARTS_COUNT];
+    if (!calc_spans(hdr, lens, url, spans)) throw URIError(errmsg);
+
+    data_t* d = (data_t*)malloc(len);
+    if (!d) throw std::bad_alloc();
+    memcpy(d, buf, len);
+    // indexes depend on order of registration, which may differ in the process that dumped the buffer
+    URI::scheme_info_t* info = URI::find_scheme(url, lens[0]);
+    d->scheme_index = info ? info->index : -1;
+
+    clear();
+    _data = d;
+}
+
+bool PackedURI::calc_spans (const data_t& hdr, const uint32_t* lens, const char* url, span_t* spans) {
+    memset(spans, 0, sizeof(span_t) * URIView::PARTS_COUNT);
+    size_t len = hdr.len, pos = 0;
+    if (lens[0]) {
+        if (lens[0] >= len || url[lens[0]] != ':') return false;
+        spans[URIView::SCHEME].length = lens[0];
+        pos = lens[0] + 1;
+    }
+    if (lens[2]) {
+        if (len - pos < 2 || url[pos] != '/' || url[pos+1] != '/') return false;
+        pos += 2;
+        if (lens[1]) {
+            if (lens[1] >= len - pos || url[pos + lens[1]] != '@') return false;
+            spans[URIView::USER_INFO].start  = pos;
+            spans[URIView::USER_INFO].length = lens[1];
+            pos += lens[1] + 1;
+        }
+        if (lens[2] > len - pos) return false;
+        spans[URIView::HOST].start  = pos;
+        spans[URIView::HOST].length = lens[2];
+        pos += lens[2];
+        if (hdr.port) {
+            char   digits[5];
+            size_t n = print_port(hdr.port, digits);
+            if (len - pos <= n || url[pos] != ':' || memcmp(url + pos + 1, digits, n)) return false;
+            spans[URIView::PORT].start  = pos + 1;
+            spans[URIView::PORT].length = n;
+            pos += n + 1;
+        }
+    }
+    else if (lens[1]) return false; // user_info is written only with host
+
+    if (lens[3] > len - pos) return false;
+    spans[URIView::PATH].start  = pos;
+    spans[URIView::PATH].length = lens[3];
+    pos += lens[3];
+
+    if (lens[4]) {
+        if (lens[4] >= len - pos || url[pos] != '?') return false;
+        spans[URIView::QUERY].start  = pos + 1;
+        spans[URIView::QUERY].length = lens[4];
+        pos += lens[4] + 1;
+    }
+
+    if (pos < len) { // the rest is fragment, which is written only if not empty
+        if (len - pos < 2 || url[pos] != '#') return false;
+        spans[URIView::FRAGMENT].start  = pos + 1;
+        spans[URIView::FRAGMENT].length = len - pos - 1;
+    }
+    return true;
+}
+
+void PackedURI::get_spans (span_t* spans) const {
+    const char* p = (const char*)(_data + 1);
+    uint32_t lens[LENS];
+    if (_data->len > 0xFFFF) memcpy(lens, p, sizeof(lens));
+    else for (int i = 0; i < LENS; ++i) lens[i] = ((const uint16_t*)p)[i];
+    calc_spans(*_data, lens, data(), spans);
+}
+
+void PackedURI::clear () {
+    free(_data);
+    _data = NULL;
+}
+
+uint16_t PackedURI::default_port () const {
+    int idx = scheme_index();
+    return idx < 0 ? 0 : URI::schemas[idx]->default_port;
+}
+
+bool PackedURI::secure () const {
+    int idx = scheme_index();
+    return idx < 0 ? false : URI::schemas[idx]->secure;
+}
+
+URIView PackedURI::view () const {
+    URIView view;
+    view._str  = data();
+    view._len  = length();
+    view._port = explicit_port();
+    if (!_data) return view;
+    span_t spans[URIView::PARTS_COUNT];
+    get_spans(spans);
+    for (int i = 0; i < URIView::PARTS_COUNT; ++i) {
+        view._spans[i].start  = spans[i].start;
+        view._spans[i].length = spans[i].length;
+    }
+    return view;
+}
+
+void PackedURI::to_uri (URI& uri) const {
+    URI tmp(view(), flags());
+    uri.assign(tmp);
+}
+
+}}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+#include <panda/string.h>
+#include <panda/uri/URI.h>
+#include <panda/uri/URIView.h>
+
+namespace panda { namespace uri {
+
+using panda::string;
+
+/* Compact read-only form of uri for keeping millions of urls in memory. Encoded url (the same as URI::to_string() gives) is stored
+ * once in a single allocation, after a small header with explicit port, scheme index, flags and lengths of components (their offsets
+ * follow from the fixed order of components and delimiters). The object itself is just a pointer. Components are returned as is
+ * (not decoded), as strings referencing the packed buffer (like URIView does), so they must not outlive the object. Conversion from
+ * URI serializes it straight into the buffer, conversion to URI takes components by offsets without parsing.
+ * Packed buffer may be saved with dump() and restored with load(), which validates it. */
+class PackedURI {
+public:
+    PackedURI ()                        : _data(NULL) {}
+    PackedURI (const URI& uri)          : _data(NULL) { assign(uri); }
+    PackedURI (const PackedURI& source) : _data(NULL) { assign(source); }
+
+    PackedURI& operator= (const URI& uri)          { assign(uri); return *this; }
+    PackedURI& operator= (const PackedURI& source) { if (this != &source) assign(source); return *this; }
+
+    void assign (const URI& uri);
+    void assign (const PackedURI& source);
+    void clear  ();
+
+    string dump () const { return _data ? string((const char*)_data, bytes()) : string(); }
+    void   load (const char* buf, size_t len); // from dump(), throws URIError if buffer is truncated or malformed
+    void   load (const string& buf) { load(buf.data(), buf.length()); }
+
+    string   scheme        () const { return part(URIView::SCHEME); }
+    string   user_info     () const { return part(URIView::USER_INFO); }
+    string   host          () const { return part(URIView::HOST); }
+    string   path          () const { return part(URIView::PATH); }
+    string   query_string  () const { return part(URIView::QUERY); }
+    string   fragment      () const { return part(URIView::FRAGMENT); }
+    uint16_t explicit_port () const { return _data ? _data->port : 0; }
+    uint16_t default_port  () const;
+    uint16_t port          () const { return explicit_port() ? explicit_port() : default_port(); }
+    bool     secure        () const;
+    int      scheme_index  () const { return _data ? _data->scheme_index : -1; }
+    int      flags         () const { return _data ? _data->flags : 0; }
+
+    string part (URIView::part_t part) const {
+        if (!_data) return string();
+        span_t spans[URIView::PARTS_COUNT];
+        get_spans(spans);
+        return string(data() + spans[part].start, spans[part].length, string::REF);
+    }
+
+    const char* data   () const { return _data ? (const char*)(_data + 1) + lens_size(_data->len) : ""; }
+    size_t      length () const { return _data ? _data->len : 0; }
+    bool        empty  () const { return !length(); }
+    size_t      bytes  () const { return _data ? sizeof(data_t) + lens_size(_data->len) + _data->len : 0; } // memory used
+
+    string to_string () const { return string(data(), length()); }
+
+    URIView view   () const;                                          // view of packed url (valid while object lives)
+    URI*    to_uri () const { return URI::create(view(), flags()); } // strict uri, like URI::create()
+    void    to_uri (URI& uri) const;
+
+    bool operator== (const PackedURI& other) const { return length() == other.length() && !memcmp(data(), other.data(), length()); }
+    bool operator!= (const PackedURI& other) const { return !operator==(other); }
+
+    void swap (PackedURI& other) { std::swap(_data, other._data); }
+
+    ~PackedURI () { clear(); }
+
+private:
+    struct span_t {
+        uint32_t start;
+        uint32_t length;
+    };
+
+    /* followed by lengths of scheme, user_info, host, path and query (uint16_t if url is shorter than 64K, uint32_t otherwise),
+     * then by url itself. Lengths of port and fragment are known from port and the rest of url. */
+    struct data_t {
+        uint32_t len;
+        uint16_t port;
+        int8_t   scheme_index; // there can't be more than 128 schemes (see URI::register_scheme)
+        uint8_t  flags;
+    };
+
+    enum { LENS = 5 };
+
+    data_t* _data;
+
+    static size_t lens_size (uint32_t len) { return len > 0xFFFF ? LENS * sizeof(uint32_t) : LENS * sizeof(uint16_t); }
+
+    // returns false if lengths don't match the url (only possible for loaded buffers)
+    static bool calc_spans (const data_t& hdr, const uint32_t* lens, const char* url, span_t* spans);
+
+    void get_spans (span_t* spans) const;
+};
+
+inline void swap (PackedURI& l, PackedURI& r) { l.swap(r); }
+
+}}
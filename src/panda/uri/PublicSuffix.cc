@@ -0,0 +1,263 @@
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <panda/uri/URI.h>
+#include <panda/uri/PublicSuffix.h>
+
+namespace panda { namespace uri {
+
+static const char     MAGIC[4]   = {'P', 'S', 'L', '1'};
+static const uint32_t BOM = 0x01020304;
+
+static inline unsigned char lower (unsigned char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+namespace {
+    struct tnode_t {
+        tnode_t () : flags(0) {}
+        std::map<std::string, size_t> children;
+        uint8_t                       flags;
+    };
+}
+
+string PublicSuffix::compile (const char* list, size_t len) {
+    std::vector<tnode_t> tree(1);
+    const char* end = list + len;
+    for (const char* p = list; p < end;) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        const char* s = p;
+        p = eol + 1;
+
+        // a rule is the first whitespace-delimited word of a line, lines starting with '//' are comments
+        while (s < eol && (*s == ' ' || *s == '\t' || *s == '\r')) ++s;
+        const char* e = s;
+        while (e < eol && *e != ' ' && *e != '\t' && *e != '\r') ++e;
+        if (s == e || (e - s >= 2 && s[0] == '/' && s[1] == '/')) continue;
+
+        uint8_t flag = RULE;
+        if (*s == '!') { flag = EXCEPTION; ++s; }
+        if (e - s >= 2 && s[0] == '*' && s[1] == '.' && flag == RULE) { flag = WILDCARD; s += 2; }
+        if (s == e || (flag == EXCEPTION && !memchr(s, '.', e - s))) continue; // '!tld' would make nothing public
+
+        std::vector<std::string> labels;
+        bool valid = true;
+        for (size_t le = e - s; valid;) { // labels from right to left
+            size_t ls = le;
+            while (ls && s[ls-1] != '.') --ls;
+            std::string label(s + ls, le - ls);
+            for (size_t i = 0; i < label.length(); ++i) label[i] = lower(label[i]);
+            valid = label.length() && label.length() <= 255 && label.find('*') == std::string::npos;
+            labels.push_back(label);
+            if (!ls) break;
+            le = ls - 1;
+        }
+        if (!valid) continue;
+
+        size_t idx = 0;
+        for (size_t i = 0; i < labels.size(); ++i) {
+            std::map<std::string, size_t>::iterator it = tree[idx].children.find(labels[i]);
+            if (it == tree[idx].children.end()) {
+                tree.push_back(tnode_t());
+                it = tree[idx].children.insert(std::make_pair(labels[i], tree.size() - 1)).first;
+            }
+            idx = it->second;
+        }
+        tree[idx].flags |= flag;
+    }
+
+    // breadth-first, so that children of every node get consecutive indexes; std::map keeps them sorted like memcmp() does
+    std::vector<node_t> nodes(tree.size());
+    std::string         labels;
+    std::deque<size_t>  queue(1, 0);
+    uint32_t            next = 1;
+    for (uint32_t cur = 0; queue.size(); ++cur) {
+        const tnode_t& tn = tree[queue.front()];
+        queue.pop_front();
+        node_t& node   = nodes[cur];
+        node.flags     = tn.flags;
+        node.children  = next;
+        node.nchildren = tn.children.size();
+        for (std::map<std::string, size_t>::const_iterator it = tn.children.begin(); it != tn.children.end(); ++it) {
+            node_t& child   = nodes[next++];
+            child.label     = labels.length();
+            child.label_len = it->first.length();
+            labels += it->first;
+            queue.push_back(it->second);
+        }
+    }
+
+    header_t hdr;
+    memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+    hdr.byte_order  = BOM;
+    hdr.nnodes      = nodes.size();
+    hdr.labels_size = labels.length();
+
+    size_t nodes_size = nodes.size() * sizeof(node_t);
+    string ret;
+    char* buf = ret.reserve(sizeof(hdr) + nodes_size + labels.length());
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), &nodes[0], nodes_size);
+    memcpy(buf + sizeof(hdr) + nodes_size, labels.data(), labels.length());
+    ret.resize(sizeof(hdr) + nodes_size + labels.length());
+    return ret;
+}
+
+void PublicSuffix::_attach (const char* data, size_t size, bool mapped) {
+    header_t hdr;
+    bool valid = size >= sizeof(hdr);
+    if (valid) {
+        memcpy(&hdr, data, sizeof(hdr));
+        valid = !memcmp(hdr.magic, MAGIC, sizeof(MAGIC)) && hdr.byte_order == BOM && hdr.nnodes &&
+                size == sizeof(hdr) + (size_t)hdr.nnodes * sizeof(node_t) + hdr.labels_size;
+    }
+    const node_t* nodes = valid ? (const node_t*)(data + sizeof(hdr)) : NULL;
+    for (uint32_t i = 0; valid && i < hdr.nnodes; ++i) {
+        const node_t& n = nodes[i];
+        valid = n.children <= hdr.nnodes && n.nchildren <= hdr.nnodes - n.children && n.label <= hdr.labels_size &&
+                n.label_len <= hdr.labels_size - n.label;
+    }
+    if (!valid) {
+        if (mapped) munmap((void*)data, size);
+        else free((void*)data);
+        throw URIError("PublicSuffix: not a compiled list or it was compiled on a machine with different byte order");
+    }
+
+    clear();
+    _data   = data;
+    _size   = size;
+    _mapped = mapped;
+    _nodes  = nodes;
+    _labels = data + sizeof(hdr) + hdr.nnodes * sizeof(node_t);
+    _nnodes = hdr.nnodes;
+}
+
+void PublicSuffix::assign (const char* blob, size_t len) {
+    // malloc'ed copy is aligned for nodes, while the source string may be not
+    char* data = (char*)malloc(len ? len : 1);
+    if (!data) throw std::bad_alloc();
+    memcpy(data, blob, len);
+    _attach(data, len, false);
+}
+
+void PublicSuffix::load (const string& path) {
+    std::string fname(path.data(), path.length());
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) throw URIError("PublicSuffix: can't open " + fname + ": " + strerror(errno));
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (data == MAP_FAILED) throw URIError("PublicSuffix: can't map " + fname + ": " + (st.st_size > 0 ? strerror(err) : "empty file"));
+    _attach((const char*)data, st.st_size, true);
+}
+
+void PublicSuffix::clear () {
+    if (_data) {
+        if (_mapped) munmap((void*)_data, _size);
+        else free((void*)_data);
+    }
+    _data   = NULL;
+    _size   = 0;
+    _mapped = false;
+    _nodes  = NULL;
+    _labels = NULL;
+    _nnodes = 0;
+}
+
+const PublicSuffix::node_t* PublicSuffix::_child (const node_t& node, const char* label, size_t len) const {
+    const node_t* children = _nodes + node.children;
+    size_t lo = 0, hi = node.nchildren;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const node_t&  c   = children[mid];
+        const uint8_t* s   = (const uint8_t*)_labels + c.label;
+        size_t         min = std::min((size_t)c.label_len, len);
+        int cmp = 0;
+        for (size_t i = 0; !cmp && i < min; ++i) cmp = (int)s[i] - (int)lower(label[i]);
+        if (!cmp) cmp = c.label_len < len ? -1 : (c.label_len > len ? 1 : 0);
+        if      (cmp < 0) lo = mid + 1;
+        else if (cmp > 0) hi = mid;
+        else return &c;
+    }
+    return NULL;
+}
+
+/* Algorithm from https://publicsuffix.org/list/: the prevailing rule is an exception rule if one matches, otherwise the matching rule
+ * with most labels or '*' if none match. Public suffix is as many host's labels as the prevailing rule has (exception rules lose
+ * their leftmost label). */
+bool PublicSuffix::find (const char* host, size_t len, result_t& res) const {
+    if (!_nnodes) return false;
+    if (len && host[len-1] == '.') --len;
+    if (!len) return false;
+
+    size_t total = 1;
+    for (size_t i = 0; i < len; ++i) if (host[i] == '.') {
+        if (i == 0 || host[i-1] == '.') return false;
+        ++total;
+    }
+    if (host[len-1] == '.') return false;
+
+    const node_t* node  = _nodes;
+    size_t        depth = 0, best = 1, pos = len;
+    while (depth < total) {
+        size_t start = pos;
+        while (start && host[start-1] != '.') --start;
+        const node_t* child = _child(*node, host + start, pos - start);
+        if (child && (child->flags & EXCEPTION)) {
+            best = depth;
+            break;
+        }
+        if ((node->flags & WILDCARD) && depth + 1 > best) best = depth + 1;
+        if (!child) break;
+        if ((child->flags & RULE) && depth + 1 > best) best = depth + 1;
+        node = child;
+        ++depth;
+        pos = start ? start - 1 : 0;
+    }
+
+    res.end    = len;
+    res.domain = string::npos;
+    size_t labels = 0;
+    for (size_t i = len; ; --i) {
+        if (i == 0 || host[i-1] == '.') {
+            ++labels;
+            if (labels == best) res.suffix = i;
+            else if (labels == best + 1) {
+                res.domain = i;
+                break;
+            }
+            if (i == 0) break;
+        }
+    }
+    return true;
+}
+
+PublicSuffix& PublicSuffix::instance () {
+    static PublicSuffix list;
+    return list;
+}
+
+static inline string host_part (const string& host, host_type_t type, const PublicSuffix& list, bool domain) {
+    string ret;
+    PublicSuffix::result_t res;
+    if (type != HOST_REG_NAME || !list.find(host.data(), host.length(), res)) return ret;
+    size_t start = domain ? res.domain : res.suffix;
+    if (start != string::npos) ret.assign(host, start, res.end - start);
+    return ret;
+}
+
+string URI::public_suffix      (const PublicSuffix& list) const { return host_part(_host, host_type(), list, false); }
+string URI::registrable_domain (const PublicSuffix& list) const { return host_part(_host, host_type(), list, true); }
+string URI::public_suffix      ()                         const { return public_suffix(PublicSuffix::instance()); }
+string URI::registrable_domain ()                         const { return registrable_domain(PublicSuffix::instance()); }
+
+}}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <panda/string.h>
+
+namespace panda { namespace uri {
+
+using panda::string;
+
+/* Public Suffix List (https://publicsuffix.org/list/) compiled into a flat trie of reversed host labels. The compiled form is a single
+ * position-independent blob: a header, an array of nodes (children of every node are contiguous and sorted) and label bytes. It can
+ * be written to a file once and then mmap'ed by every process (the pages are shared between processes and forks) or attached from
+ * memory. The object is read-only after loading, so one instance may be used by any number of threads. Lookups don't allocate.
+ * Rules are matched byte-wise and ASCII-case-insensitively, so the list must use the same form of IDN labels as hosts do
+ * (UTF-8 or punycode). */
+class PublicSuffix {
+public:
+    struct result_t {
+        size_t suffix; // offset of public suffix in host
+        size_t domain; // offset of registrable domain (public suffix + one more label), npos if host itself is a public suffix
+        size_t end;    // end of both (host length without trailing dot)
+    };
+
+    PublicSuffix () : _data(NULL), _size(0), _mapped(false), _nodes(NULL), _labels(NULL), _nnodes(0) {}
+    ~PublicSuffix () { clear(); }
+
+    static string compile (const char* list, size_t len); // from text of the list (invalid rules are skipped)
+    static string compile (const string& list) { return compile(list.data(), list.length()); }
+
+    void assign (const char* blob, size_t len); // copies compiled blob, throws URIError if it's not valid
+    void assign (const string& blob) { assign(blob.data(), blob.length()); }
+    void load   (const string& path);           // mmaps compiled file, throws URIError
+    void clear  ();
+
+    bool   loaded () const { return _nnodes; }
+    size_t bytes  () const { return _size; }
+
+    // host is expected in the form URI keeps it (decoded). Returns false if nothing is loaded or host is empty or has empty labels.
+    bool find (const char* host, size_t len, result_t& res) const;
+
+    // process-wide list used by URI::public_suffix() and URI::registrable_domain() by default; load it once at startup
+    static PublicSuffix& instance ();
+
+private:
+    struct header_t {
+        char     magic[4];
+        uint32_t byte_order; // written natively, so blobs from machines with other byte order are rejected
+        uint32_t nnodes;
+        uint32_t labels_size;
+    };
+
+    struct node_t {
+        uint32_t label;     // offset in labels
+        uint32_t children;  // index of the first child
+        uint32_t nchildren;
+        uint8_t  label_len;
+        uint8_t  flags;
+        uint16_t reserved;
+    };
+
+    enum {
+        RULE      = 1, // rule ends at this node
+        WILDCARD  = 2, // '*.<this node>' rule
+        EXCEPTION = 4  // '!<this node>' rule
+    };
+
+    const char*   _data;
+    size_t        _size;
+    bool          _mapped;
+    const node_t* _nodes;
+    const char*   _labels;
+    uint32_t      _nnodes;
+
+    void _attach (const char* data, size_t size, bool mapped);
+    const node_t* _child (const node_t& node, const char* label, size_t len) const;
+
+    PublicSuffix (const PublicSuffix&);
+    PublicSuffix& operator= (const PublicSuffix&);
+};
+
+}}
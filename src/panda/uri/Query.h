@@ -1,73 +1,282 @@
 #pragma once
-#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
 #include <panda/string.h>
 #include <panda/lib.h>
+#include <panda/uri/Arena.h>
 
 namespace panda { namespace uri {
 
 using panda::string;
 
-class Query : public std::multimap<string, string> {
-private:
-    typedef std::multimap<key_type,mapped_type> base;
+class URI;
+
+/* Multimap-like container of query params, stored in a flat vector. By default params are sorted by key (like in std::multimap,
+ * params with the same key keep the order they have been inserted in). If 'keep_order' is set, params are kept in the order
+ * they have been inserted in, except that params with the same key are grouped at the place of the first of them.
+ * In this mode lookups are linear, which is fine for typical queries with a few dozens of params.
+ * 'rev' is increased on every change made via Query's methods, URI and its perl wrapper use it to know when their caches
+ * (query string, to_string(), perl hash) are outdated. Access via non-const iterators doesn't change it, so if you modify
+ * params through an iterator, call touch() afterwards.
+ * Params are kept in a refcounted block shared by copies (so copying a query costs the same regardless of its size), which is
+ * copied on the first non-const access: any method that may change params, including non-const iterators and lookups.
+ * 'rev' belongs to the object, not to the block.
+ * A query is bound to the arena active when it is constructed (see Arena) and its storage always comes from that arena, or from the
+ * heap if there was none. Blocks are shared only by queries which could own them: heap blocks by any, arena blocks by queries of
+ * the same arena. */
+class Query {
 public:
-    typedef std::pair<iterator,iterator>             pair;
-    typedef std::pair<const_iterator,const_iterator> const_pair;
+    typedef string                                          key_type;
+    typedef string                                          mapped_type;
+    typedef std::pair<string, string>                       value_type;
+    typedef std::vector<value_type, Allocator<value_type> > container_type;
+    typedef container_type::size_type                       size_type;
+    typedef container_type::iterator                        iterator;
+    typedef container_type::const_iterator                  const_iterator;
+    typedef container_type::reverse_iterator                reverse_iterator;
+    typedef container_type::const_reverse_iterator          const_reverse_iterator;
+    typedef std::pair<iterator,iterator>                    pair;
+    typedef std::pair<const_iterator,const_iterator>        const_pair;
     uint32_t rev;
 
     explicit
-    Query (const key_compare& comp = key_compare(), const allocator_type& alloc = allocator_type()) : base(comp, alloc), rev(1) {}
+    Query (bool keep_order = false) : rev(1), _arena(Arena::current()), _block(NULL), _keep_order(keep_order) {}
 
     template <class InputIterator>
-    Query (InputIterator first, InputIterator last, const key_compare& comp = key_compare(), const allocator_type& alloc = allocator_type())
-        : base(first, last, comp, alloc), rev(1) {}
+    Query (InputIterator first, InputIterator last, bool keep_order = false) :
+        rev(1), _arena(Arena::current()), _block(NULL), _keep_order(keep_order)
+    {
+        for (; first != last; ++first) _insert(*first);
+    }
 
-    Query (const Query& x) : base(x), rev(1) {}
+    Query (const Query& x) : rev(1), _arena(Arena::current()), _block(_adopt(x._block)), _keep_order(x._keep_order) {}
 
     Query& operator= (const Query& x) {
         rev++;
-        base::operator=(x);
+        if (_block != x._block) {
+            _block_t* block = _adopt(x._block);
+            _release();
+            _block = block;
+        }
+        _keep_order = x._keep_order;
         return *this;
     }
 
+    ~Query () { _release(); }
+
+    bool keep_order () const { return _keep_order; }
+
+    void keep_order (bool val) {
+        if (val == _keep_order) return;
+        _keep_order = val;
+        if (!val && size() > 1) {
+            rev++;
+            container_type& items = _mut();
+            std::stable_sort(items.begin(), items.end(), _key_less);
+        }
+    }
+
     template <class InputIterator>
-    void     insert (InputIterator first, InputIterator last)     { rev++; return base::insert(first, last); }
-    iterator insert (const value_type& val)                       { rev++; return base::insert(val); }
-    iterator insert (iterator position, const value_type& val)    { rev++; return base::insert(position, val); }
+    void     insert (InputIterator first, InputIterator last)     { rev++; for (; first != last; ++first) _insert(*first); }
+    iterator insert (const value_type& val)                       { rev++; return _insert(val); }
+    iterator insert (iterator, const value_type& val)             { rev++; return _insert(val); }
     iterator insert (const key_type& key, const mapped_type& val) { return insert(value_type(key, val)); }
     iterator insert (const char* key, const char* val)            { return insert(value_type(key, val)); }
 
-    void      erase (iterator position)             { rev++; base::erase(position); }
-    size_type erase (const key_type& k)             { rev++; return base::erase(k); }
-    void      erase (iterator first, iterator last) { rev++; base::erase(first, last); }
+    // iterators come from non-const access, so the block is not shared already
+    void      erase (iterator position)             { rev++; _mut().erase(position); }
+    void      erase (iterator first, iterator last) { if (first == last) return; rev++; _mut().erase(first, last); }
+    size_type erase (const key_type& k) {
+        const_pair range = _equal_range(k);
+        size_type cnt = range.second - range.first;
+        if (!cnt) return 0;
+        size_type pos = range.first - _items().begin();
+        rev++;
+        container_type& items = _mut();
+        items.erase(items.begin() + pos, items.begin() + pos + cnt);
+        return cnt;
+    }
 
     void swap (Query& x) {
         rev++;
         x.rev++;
-        base::swap(x);
+        if (_arena == x._arena) std::swap(_block, x._block);
+        else { // each side keeps its own arena
+            _block_t* mine   = _adopt(x._block);
+            _block_t* theirs = x._adopt(_block);
+            _release();
+            x._release();
+            _block   = mine;
+            x._block = theirs;
+        }
+        std::swap(_keep_order, x._keep_order);
+    }
+
+    void clear () {
+        rev++;
+        if (_block && _block->refcnt > 1) _release();
+        else if (_block) _block->items.clear(); // keep capacity
+    }
+
+    void touch () { rev++; } // params have been changed via iterators
+
+    void reserve (size_type n) { _mut().reserve(n); }
+
+    size_type size  () const { return _items().size(); }
+    bool      empty () const { return _items().empty(); }
+
+    iterator         begin  () { return _mut().begin(); }
+    reverse_iterator rbegin () { return _mut().rbegin(); }
+    iterator         end    () { return _mut().end(); }
+    reverse_iterator rend   () { return _mut().rend(); }
+
+    const_iterator         begin   () const { return _items().begin(); }
+    const_iterator         end     () const { return _items().end(); }
+    const_reverse_iterator rbegin  () const { return _items().rbegin(); }
+    const_reverse_iterator rend    () const { return _items().rend(); }
+    const_iterator         cbegin  () const { return _items().begin(); }
+    const_iterator         cend    () const { return _items().end(); }
+    const_reverse_iterator crbegin () const { return _items().rbegin(); }
+    const_reverse_iterator crend   () const { return _items().rend(); }
+
+    // in 'keep_order' mode lower_bound and upper_bound return bounds of the group of params with key 'k' or end() if there are none
+    iterator       find        (const key_type& k)       { _mut(); return _unconst(_find(k)); }
+    iterator       lower_bound (const key_type& k)       { _mut(); return _unconst(_equal_range(k).first); }
+    iterator       upper_bound (const key_type& k)       { _mut(); return _unconst(_equal_range(k).second); }
+    const_iterator find        (const key_type& k) const { return _find(k); }
+    const_iterator lower_bound (const key_type& k) const { return _equal_range(k).first; }
+    const_iterator upper_bound (const key_type& k) const { return _equal_range(k).second; }
+
+    pair equal_range (const key_type& k) {
+        _mut();
+        const_pair range = _equal_range(k);
+        return pair(_unconst(range.first), _unconst(range.second));
+    }
+    const_pair equal_range (const key_type& k) const { return _equal_range(k); }
+
+    size_type count (const key_type& k) const {
+        const_pair range = equal_range(k);
+        return range.second - range.first;
     }
 
-    void clear () { rev++; base::clear(); }
+private:
+    friend class URI;
+
+    struct _block_t {
+        _block_t (Arena* arena) : refcnt(1), arena(arena), items(Allocator<value_type>(arena)) {}
+        _block_t (Arena* arena, const container_type& src) :
+            refcnt(1), arena(arena), items(src.begin(), src.end(), Allocator<value_type>(arena)) {}
+        uint32_t       refcnt;
+        Arena*         arena; // where the block and its items live, NULL for heap
+        container_type items;
+    };
 
-    iterator         begin  () { rev++; return base::begin(); }
-    reverse_iterator rbegin () { rev++; return base::rbegin(); }
-    iterator         end    () { rev++; return base::end(); }
-    reverse_iterator rend   () { rev++; return base::rend(); }
+    Arena*    _arena; // captured at construction
+    _block_t* _block; // NULL while nothing has been added
+    bool      _keep_order;
 
-    const_iterator         cbegin  () const { return base::begin(); }
-    const_iterator         cend    () const { return base::end(); }
-    const_reverse_iterator crbegin () const { return base::rbegin(); }
-    const_reverse_iterator crend   () const { return base::rend(); }
+    static const container_type _empty;
+
+    const container_type& _items () const { return _block ? _block->items : _empty; }
+
+    // params for writing: the block is created or unshared if needed
+    container_type& _mut () {
+        if (!_block) _block = _new_block(NULL);
+        else if (_block->refcnt > 1) {
+            _block_t* block = _new_block(&_block->items);
+            _release();
+            _block = block;
+        }
+        return _block->items;
+    }
 
-    iterator       find        (const key_type& k)       { rev++; return base::find(k); }
-    iterator       lower_bound (const key_type& k)       { rev++; return base::lower_bound(k); }
-    iterator       upper_bound (const key_type& k)       { rev++; return base::upper_bound(k); }
-    const_iterator find        (const key_type& k) const { return base::find(k); }
-    const_iterator lower_bound (const key_type& k) const { return base::lower_bound(k); }
-    const_iterator upper_bound (const key_type& k) const { return base::upper_bound(k); }
+    // must be called after _mut(), when const and non-const views are the same container
+    iterator _unconst (const_iterator it) { return _block->items.begin() + (it - _items().begin()); }
 
-    pair       equal_range (const key_type& k)       { rev++; return base::equal_range(k); }
-    const_pair equal_range (const key_type& k) const { return base::equal_range(k); }
+    // block of another query to be used by this one: shared if this query may own it, copied into own memory otherwise
+    _block_t* _adopt (_block_t* block) const {
+        if (!block) return NULL;
+        if (block->arena && block->arena != _arena) return _new_block(&block->items);
+        __sync_add_and_fetch(&block->refcnt, 1);
+        return block;
+    }
+
+    void _release () {
+        if (_block && !__sync_sub_and_fetch(&_block->refcnt, 1)) {
+            _block->~_block_t();
+            deallocate(_block);
+        }
+        _block = NULL;
+    }
+
+    _block_t* _new_block (const container_type* items) const {
+        void* mem = allocate(sizeof(_block_t), _arena);
+        try { return items ? new (mem) _block_t(_arena, *items) : new (mem) _block_t(_arena); }
+        catch (...) {
+            deallocate(mem);
+            throw;
+        }
+    }
+
+    static bool _key_less (const value_type& a, const value_type& b) { return a.first < b.first; }
+
+    struct _cmp {
+        bool operator() (const value_type& a, const key_type& k) const { return a.first < k; }
+        bool operator() (const key_type& k, const value_type& a) const { return k < a.first; }
+    };
+
+    const_iterator _find (const key_type& k) const {
+        const container_type& items = _items();
+        const_iterator end = items.end();
+        if (_keep_order) {
+            for (const_iterator it = items.begin(); it != end; ++it) if (it->first == k) return it;
+            return end;
+        }
+        const_iterator it = std::lower_bound(items.begin(), end, k, _cmp());
+        return (it != end && it->first == k) ? it : end;
+    }
+
+    const_pair _equal_range (const key_type& k) const {
+        const container_type& items = _items();
+        if (!_keep_order) return std::equal_range(items.begin(), items.end(), k, _cmp());
+        const_iterator first = _find(k), end = items.end(), last = first;
+        while (last != end && last->first == k) ++last;
+        return const_pair(first, last);
+    }
+
+    iterator _insert (const value_type& val) {
+        container_type& items = _mut();
+        // fast path for params coming in already sorted order or for a new key in 'keep_order' mode
+        if (items.empty() || (!_keep_order && !(val.first < items.back().first))) {
+            items.push_back(val);
+            return items.end() - 1;
+        }
+        iterator pos = _keep_order ? _unconst(_equal_range(val.first).second) : std::upper_bound(items.begin(), items.end(), val.first, _cmp());
+        return items.insert(pos, val);
+    }
+
+    // URI::parse_query appends params right into _mut() and then restores the ordering in one pass
+    void _restore_order () {
+        if (size() < 2) return;
+        container_type& items = _mut();
+        iterator end = items.end();
+        if (!_keep_order) {
+            for (iterator it = items.begin() + 1; it != end; ++it) if (it->first < (it-1)->first) {
+                std::stable_sort(items.begin(), end, _key_less);
+                break;
+            }
+            return;
+        }
+        for (iterator it = items.begin(); it != end; ++it) {
+            iterator next = it + 1;
+            for (iterator jt = next; jt != end; ++jt) if (jt->first == it->first) {
+                if (jt != next) std::rotate(next, jt, jt + 1);
+                ++next;
+            }
+            it = next - 1;
+        }
+    }
 };
 
 }}
@@ -0,0 +1,174 @@
+#include <cstring>
+#include <algorithm>
+#include <panda/uri/Router.h>
+
+namespace panda { namespace uri {
+
+// position of 'seg' among sorted children or, if there is no such segment, the position to insert it at
+size_t Router::_lower (const std::vector<child_t>& children, const char* seg, size_t len, bool& found) {
+    size_t lo = 0, hi = children.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const string& s = children[mid].segment;
+        int cmp = memcmp(s.data(), seg, std::min(s.length(), len));
+        if (!cmp) cmp = s.length() < len ? -1 : (s.length() > len ? 1 : 0);
+        if      (cmp < 0) lo = mid + 1;
+        else if (cmp > 0) hi = mid;
+        else {
+            found = true;
+            return mid;
+        }
+    }
+    found = false;
+    return lo;
+}
+
+int Router::add (const string& pattern) {
+    string pat(pattern);
+    pat.retain(); // capture names and literal segments share its buffer
+    const char* p   = pat.data();
+    size_t      len = pat.length();
+    if (!len || p[0] != '/') throw RouterError("Router: pattern must start with '/': " + std::string(p, len));
+
+    // the whole pattern is checked before the trie is touched, so that rejected patterns leave nothing behind
+    std::vector<segment_t> segments;
+    route_t route;
+    for (size_t pos = 0; pos < len;) {
+        while (pos < len && p[pos] == '/') ++pos;
+        if (pos == len) break;
+        if (segments.size() && segments.back().kind == SEG_REST)
+            throw RouterError("Router: '*' must be the last segment: " + std::string(p, len));
+        size_t end = pos;
+        while (end < len && p[end] != '/') ++end;
+
+        segment_t seg;
+        if (p[pos] == ':' || p[pos] == '*') {
+            string name;
+            if (end - pos > 1) name.assign(pat, pos + 1, end - pos - 1);
+            else if (p[pos] == ':') throw RouterError("Router: empty param name: " + std::string(p, len));
+            else name.assign(pat, pos, 1);
+            route.params.push_back(name);
+            seg.kind = p[pos] == '*' ? SEG_REST : SEG_PARAM;
+        }
+        else {
+            seg.kind = SEG_LITERAL;
+            decode_uri_component(pat, pos, end - pos, seg.literal);
+        }
+        segments.push_back(seg);
+        pos = end;
+    }
+    if (route.params.size() > RouteMatch::MAX_CAPTURES) throw RouterError("Router: too many captures: " + std::string(p, len));
+    bool rest = segments.size() && segments.back().kind == SEG_REST;
+    size_t nsegs = segments.size() - (rest ? 1 : 0);
+
+    // duplicate check walks existing nodes only
+    uint32_t idx = 0;
+    size_t   n   = 0;
+    for (; n < nsegs; ++n) {
+        const node_t& node = _nodes[idx];
+        if (segments[n].kind == SEG_PARAM) {
+            if (!node.param) break;
+            idx = node.param;
+            continue;
+        }
+        bool   found;
+        size_t i = _lower(node.children, segments[n].literal.data(), segments[n].literal.length(), found);
+        if (!found) break;
+        idx = node.children[i].node;
+    }
+    if (n == nsegs && (rest ? _nodes[idx].rest_route : _nodes[idx].route) >= 0)
+        throw RouterError("Router: duplicate pattern: " + std::string(p, len));
+
+    for (; n < nsegs; ++n) {
+        uint32_t node = _nodes.size();
+        _nodes.push_back(node_t());
+        if (segments[n].kind == SEG_PARAM) _nodes[idx].param = node;
+        else {
+            bool   found;
+            size_t i = _lower(_nodes[idx].children, segments[n].literal.data(), segments[n].literal.length(), found);
+            child_t child;
+            child.segment = segments[n].literal;
+            child.node    = node;
+            _nodes[idx].children.insert(_nodes[idx].children.begin() + i, child);
+        }
+        idx = node;
+    }
+
+    route.pattern = pat;
+    _routes.push_back(route);
+    int id = _routes.size() - 1;
+    if (rest) _nodes[idx].rest_route = id;
+    else      _nodes[idx].route      = id;
+    return id;
+}
+
+bool Router::_match (uint32_t idx, const char* path, size_t pos, size_t len, RouteMatch& m) const {
+    while (pos < len && path[pos] == '/') ++pos;
+    const node_t& node = _nodes[idx];
+    size_t n = m.ncaptures;
+
+    if (pos == len) {
+        if (node.route >= 0) {
+            m.route = node.route;
+            return true;
+        }
+        if (node.rest_route < 0) return false;
+        m._spans[n].start  = len;
+        m._spans[n].length = 0;
+        m.ncaptures = n + 1;
+        m.route = node.rest_route;
+        return true;
+    }
+
+    const char* sep = (const char*)memchr(path + pos, '/', len - pos);
+    size_t end = sep ? sep - path : len;
+
+    if (node.children.size()) {
+        size_t seglen = end - pos;
+        bool   found;
+        size_t i;
+        if (find_uri_escape(path + pos, seglen) == seglen) i = _lower(node.children, path + pos, seglen, found);
+        else { // literal segments are stored decoded
+            string seg;
+            decode_uri_component(path + pos, seglen, seg);
+            i = _lower(node.children, seg.data(), seg.length(), found);
+        }
+        if (found && _match(node.children[i].node, path, end, len, m)) return true;
+    }
+
+    if (node.param) {
+        m._spans[n].start  = pos;
+        m._spans[n].length = end - pos;
+        m.ncaptures = n + 1;
+        if (_match(node.param, path, end, len, m)) return true;
+        m.ncaptures = n;
+    }
+
+    if (node.rest_route >= 0) {
+        m._spans[n].start  = pos;
+        m._spans[n].length = len - pos;
+        m.ncaptures = n + 1;
+        m.route = node.rest_route;
+        return true;
+    }
+
+    return false;
+}
+
+int Router::match (const string& path, RouteMatch& m) const {
+    m._path     = path;
+    m.route     = -1;
+    m.ncaptures = 0;
+    if (!_match(0, path.data(), 0, path.length(), m)) {
+        m.route     = -1;
+        m.ncaptures = 0;
+    }
+    return m.route;
+}
+
+void Router::clear () {
+    _nodes.assign(1, node_t());
+    _routes.clear();
+}
+
+}}
@@ -0,0 +1,115 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <panda/string.h>
+#include <panda/uri/URI.h>
+
+namespace panda { namespace uri {
+
+using panda::string;
+
+class RouterError : public URIError {
+public:
+  explicit RouterError (const std::string& what_arg) : URIError(what_arg) {}
+};
+
+/* Result of Router::match(). Captures are kept as spans of the matched path (which is shared, not copied), they are only decoded
+ * when asked for and, if there is nothing to decode, returned strings just share path's buffer. */
+class RouteMatch {
+public:
+    static const size_t MAX_CAPTURES = 16;
+
+    struct span_t {
+        uint32_t start;
+        uint32_t length;
+    };
+
+    RouteMatch () : route(-1), ncaptures(0) {}
+
+    int    route;     // id of matched route, -1 if nothing matched
+    size_t ncaptures;
+
+    const string& path () const { return _path; }
+
+    span_t span (size_t i) const { return _spans[i]; }
+    string raw (size_t i) const {
+        string ret;
+        ret.assign(_path, _spans[i].start, _spans[i].length);
+        return ret;
+    }
+
+    string capture (size_t i) const {
+        string ret;
+        decode_uri_component(_path, _spans[i].start, _spans[i].length, ret);
+        return ret;
+    }
+
+private:
+    friend class Router;
+
+    string _path;
+    span_t _spans[MAX_CAPTURES];
+};
+
+/* Matches paths against a set of patterns like "/users/:id" or "/files/:user/ *" (without the space). Patterns are compiled into a
+ * trie of path segments, so matching walks the path once (with backtracking only when several kinds of nodes fit) and costs the same regardless of number of routes.
+ * Segments are split by '/' and empty ones are skipped, like URI::path_segments() does, so "/a//b/" is the same as "/a/b".
+ * Pattern segments are:
+ *     literal - matches the same segment (after decoding)
+ *     :name   - matches any non-empty segment and captures it
+ *     *name   - (or just '*') may only be the last one, matches the rest of the path (maybe empty) and captures it
+ * Captures are decoded by RouteMatch::capture(), so an escaped '/' in the rest of the path can only be told from a real one by
+ * RouteMatch::raw()
+ * When several routes fit, literal segments take precedence over params and params over the rest of the path. */
+class Router {
+public:
+    Router () : _nodes(1) {}
+
+    /* Adds pattern and returns its id (ids are consecutive numbers from 0). Throws RouterError if pattern is malformed or already
+     * exists (even with different capture names). */
+    int add (const string& pattern);
+
+    int match (const string& path, RouteMatch& m) const;
+    int match (const URI& uri, RouteMatch& m) const { return match(uri.path(), m); }
+
+    size_t                     size    ()          const { return _routes.size(); }
+    const string&              pattern (int route) const { return _routes[route].pattern; }
+    const std::vector<string>& params  (int route) const { return _routes[route].params; } // capture names in order
+
+    void clear ();
+
+private:
+    struct child_t {
+        string   segment; // decoded
+        uint32_t node;
+    };
+
+    struct node_t {
+        node_t () : param(0), route(-1), rest_route(-1) {}
+        std::vector<child_t> children;   // literal segments, sorted
+        uint32_t             param;      // node for ':name' segment, 0 if none (root is never a child)
+        int                  route;      // route ending at this node
+        int                  rest_route; // route ending with '*' at this node
+    };
+
+    struct route_t {
+        string              pattern;
+        std::vector<string> params;
+    };
+
+    enum seg_kind_t { SEG_LITERAL, SEG_PARAM, SEG_REST };
+
+    struct segment_t {
+        seg_kind_t kind;
+        string     literal; // decoded
+    };
+
+    std::vector<node_t>  _nodes;
+    std::vector<route_t> _routes;
+
+    bool _match (uint32_t idx, const char* path, size_t pos, size_t len, RouteMatch& m) const;
+
+    static size_t _lower (const std::vector<child_t>& children, const char* seg, size_t len, bool& found);
+};
+
+}}
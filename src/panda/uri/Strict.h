@@ -41,11 +41,10 @@ protected:
     }
 
     string my_scheme (const std::type_info* ti = NULL) {
-        const char* classname = ti ? ti->name() : typeid(*this).name();
-        SchemeTIMap::iterator it = scheme_ti_map.find(panda::lib::string_hash(classname));
-        if (it == scheme_ti_map.end())
-            throw URIError(string("URI: tried to use class ") + classname + " which has not been registered");
-        return it->second->scheme;
+        if (!ti) ti = &typeid(*this);
+        scheme_info_t* info = find_scheme(ti);
+        if (!info) throw URIError(string("URI: tried to use class ") + ti->name() + " which has not been registered");
+        return info->scheme;
     }
 };
 
@@ -63,6 +62,7 @@ public:
         size_t delim = _user_info.find(':');
         if (delim == string::npos) _user_info = user;
         else _user_info.replace(0, delim, user);
+        changed();
     }
 
     const string password () const {
@@ -78,6 +78,7 @@ public:
             _user_info += password;
         }
         else _user_info.replace(delim+1, string::npos, password);
+        changed();
     }
 };
 
@@ -1,3 +1,5 @@
+#include <cstring>
+#include <algorithm>
 #include <stdexcept>
 #include <panda/lib.h>
 #include <panda/uri/all.h>
@@ -7,19 +9,6 @@ namespace panda { namespace uri {
 typedef unsigned char uchar;
 using panda::lib::string_hash;
 
-enum state_t {
-    STATE_NONE   = -1,
-    STATE_SCHEME = 0,
-    STATE_UINFO,
-    STATE_HOST,
-    STATE_HOST_IPV6,
-    STATE_PORT,
-    STATE_PATH,
-    STATE_QUERY,
-    STATE_FRAGMENT,
-    STATE_END
-};
-
 enum token_flags_t {
     TF_CROP     = 1,
     TF_SUBSTATE = 2
@@ -33,32 +22,98 @@ struct token_t {
     token_t (state_t ss, state_t ns, int flags = 0) : seen_state(ss), next_state(ns), flags(flags) {}
 };
 
-struct mark_t {
-    ssize_t start;
-    ssize_t end;
-};
-
 static token_t parseinfo[STATE_END][256];
 static char unsafe_port[256];
 
-const string      URI::_empty;
-URI::SchemeMap    URI::scheme_map;
-URI::SchemeTIMap  URI::scheme_ti_map;
-URI::SchemeVector URI::schemas;
+const Query::container_type       Query::_empty;
+URI::SchemeVector                 URI::schemas;
+URI::scheme_info_t* volatile      URI::scheme_table[SCHEME_TABLE_SIZE];
+URI::scheme_info_t* volatile      URI::builtin_schemes[BUILTIN_SCHEMES];
+URI::scheme_info_t* volatile      URI::scheme_ti_table[SCHEME_TABLE_SIZE];
+volatile int                      URI::scheme_lock;
+
+static inline char scheme_lc (char c) { return (c >= 'A' && c <= 'Z') ? (c | 0x20) : c; }
+
+static inline uint32_t scheme_hash (const char* scheme, size_t len) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; ++i) hash = (hash ^ (uchar)scheme_lc(scheme[i])) * 16777619u;
+    return hash;
+}
+
+static inline bool scheme_eq (const string& lcscheme, const char* scheme, size_t len) {
+    if (lcscheme.length() != len) return false;
+    const char* p = lcscheme.data();
+    for (size_t i = 0; i < len; ++i) if (p[i] != scheme_lc(scheme[i])) return false;
+    return true;
+}
 
-void URI::register_scheme (const string& scheme, const std::type_info* ti, uricreator creator, uint16_t default_port, bool secure) {
-    if (scheme_map.find(scheme) != scheme_map.end())
+/* The first registered scheme of every short length (http, https and ftp, as they are registered first and have different
+ * lengths) is found by length without hashing, the others are found in open-addressing table. Strict classes find their scheme
+ * in another such table by name of type_info (names, unlike type_info objects, are the same across shared objects).
+ * Lookups are lock-free.
+ * Registration is serialized by a spinlock and publishes fully constructed scheme_info_t after a barrier. Entries are never freed
+ * (uris may still point to replaced ones), so schemes may be registered while other threads are parsing urls.
+ * Scheme without type info and creator just reserves an index (XS uses it to bind perl class to the scheme) and may be
+ * registered again with a creator later. */
+static inline bool ti_eq (const std::type_info* a, const std::type_info* b) { return a == b || !strcmp(a->name(), b->name()); }
+
+int URI::register_scheme (const string& scheme, const std::type_info* ti, uricreator creator, uint16_t default_port, bool secure) {
+    const size_t mask = SCHEME_TABLE_SIZE - 1;
+    size_t len = scheme.length();
+    uint32_t hash = scheme_hash(scheme.data(), len);
+
+    while (__sync_lock_test_and_set(&scheme_lock, 1)) {}
+
+    size_t slot = hash & mask;
+    scheme_info_t* old;
+    while ((old = scheme_table[slot]) && !(old->hash == hash && scheme_eq(old->scheme, scheme.data(), len))) slot = (slot + 1) & mask;
+
+    if (old && old->creator) {
+        __sync_lock_release(&scheme_lock);
         throw std::invalid_argument("URI::register_scheme: scheme '" + scheme + "' has been already registered");
+    }
+    if (!old && schemas.size() >= SCHEME_TABLE_SIZE / 2) {
+        __sync_lock_release(&scheme_lock);
+        throw std::length_error("URI::register_scheme: too many schemes");
+    }
+
+    if (!schemas.capacity()) schemas.reserve(SCHEME_TABLE_SIZE / 2); // never reallocated, so it can be read by index without lock
+
     scheme_info_t* inf = new scheme_info_t;
-    inf->index         = schemas.size();
-    inf->scheme        = scheme;
+    inf->index         = old ? old->index : schemas.size();
+    inf->scheme.assign(scheme.data(), len, string::COPY);
+    inf->hash          = hash;
     inf->creator       = creator;
     inf->default_port  = default_port;
     inf->secure        = secure;
     inf->type_info     = ti;
-    scheme_map[scheme] = inf;
-    scheme_ti_map[string_hash(ti->name())] = inf;
-    schemas.push_back(inf);
+    inf->binding       = old ? old->binding : NULL;
+    char* p = inf->scheme.buf();
+    for (size_t i = 0; i < len; ++i) p[i] = scheme_lc(p[i]);
+
+    if (old) schemas[inf->index] = inf;
+    else     schemas.push_back(inf);
+
+    __sync_synchronize();
+    scheme_table[slot] = inf;
+    if (ti) { // the table can't be full as there are fewer classes than slots
+        size_t ti_slot = string_hash(ti->name()) & mask;
+        while (scheme_ti_table[ti_slot] && !ti_eq(scheme_ti_table[ti_slot]->type_info, ti)) ti_slot = (ti_slot + 1) & mask;
+        scheme_ti_table[ti_slot] = inf;
+    }
+    if (len < BUILTIN_SCHEMES && (!builtin_schemes[len] || builtin_schemes[len] == old)) builtin_schemes[len] = inf;
+
+    __sync_lock_release(&scheme_lock);
+    return inf->index;
+}
+
+void URI::scheme_binding (int index, void* data) {
+    while (__sync_lock_test_and_set(&scheme_lock, 1)) {}
+    if (index >= 0 && (size_t)index < schemas.size()) {
+        __sync_synchronize(); // data must be complete before readers may see it
+        schemas[index]->binding = data;
+    }
+    __sync_lock_release(&scheme_lock);
 }
 
 static URI* new_http  (const URI& source) { return new URI::http(source); }
@@ -112,74 +167,146 @@ static int init () {
 }
 static const int __init = init();
 
-inline void URI::guess_leading_authority () {
+URI::scheme_info_t* URI::find_scheme (const char* scheme, size_t len) {
+    if (len < BUILTIN_SCHEMES) {
+        scheme_info_t* info = builtin_schemes[len];
+        if (info && scheme_eq(info->scheme, scheme, len)) return info;
+    }
+
+    const size_t mask = SCHEME_TABLE_SIZE - 1;
+    uint32_t hash = scheme_hash(scheme, len);
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        scheme_info_t* info = scheme_table[slot];
+        if (!info) return NULL;
+        if (info->hash == hash && scheme_eq(info->scheme, scheme, len)) return info;
+    }
+}
+
+URI::scheme_info_t* URI::find_scheme (const std::type_info* ti) {
+    const size_t mask = SCHEME_TABLE_SIZE - 1;
+    for (size_t slot = string_hash(ti->name()) & mask;; slot = (slot + 1) & mask) {
+        scheme_info_t* info = scheme_ti_table[slot];
+        if (!info || ti_eq(info->type_info, ti)) return info;
+    }
+}
+
+static inline void guess_leading_authority (const char* p, mark_t* marks) {
     // try to find out if it was an url with leading authority ('ya.ru', 'ya.ru:80/a/b/c', 'user@mysite.com/a/b/c')
     // in either case host is always empty and there are 2 cases
     // 1) if no scheme -> host is first path part, port is absent
     // 2) if scheme is present and first path part is a valid port -> scheme is host, first path part is port.
     // otherwise leave parsed url unchanged as it has no leading authority
-    if (!_scheme.length()) {
-        //_scheme = default_scheme;
-        size_t delim = _path.find('/');
-        if (delim == string::npos) {
-            _host = _path;
-            _path = _empty;
-        } else {
-            _host.assign(_path, 0, delim);
-            _path.erase(0, delim);
-        }
+    mark_t& path = marks[STATE_PATH];
+    if (path.end <= path.start) return;
+
+    mark_t& scheme = marks[STATE_SCHEME];
+    if (scheme.end <= scheme.start) {
+        ssize_t delim = path.start;
+        while (delim < path.end && p[delim] != '/') ++delim;
+        marks[STATE_HOST].start = path.start;
+        marks[STATE_HOST].end   = delim;
+        path.start = delim;
         return;
     }
 
-    bool ok = false;
-    size_t plen = _path.length();
-    const char* p = _path.data();
-    size_t i = 0;
-    for (; i < plen; ++i) {
-        if (unsafe_port[(uchar)p[i]]) {
-            _port = _port * 10 + (p[i] - '0');
-            ok = true;
-            continue;
-        }
-        if (p[i] != '/') { _port = 0; return; }
-        break;
-    }
+    ssize_t i = path.start;
+    while (i < path.end && unsafe_port[(uchar)p[i]]) ++i;
+    if (i == path.start || (i < path.end && p[i] != '/')) return;
 
-    if (!ok) return;
-    _host = _scheme;
-    _scheme.clear();
-    _path.erase(0, i);
+    marks[STATE_HOST]       = scheme;
+    marks[STATE_PORT].start = path.start;
+    marks[STATE_PORT].end   = i;
+    scheme.end = -1;
+    path.start = i;
 }
 
-void URI::parse (const string& uristr) {
-    const char* p = uristr.data();
-    size_t len = uristr.length();
-    size_t i = 0;
-
-    mark_t marks[STATE_END] = {{0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}};
-    state_t state;
+static const mark_t initial_marks[STATE_END] = {{0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}, {0,-1}};
 
+/* Chooses initial state, needs 2 bytes to see if url starts with '//' unless 'final' is set.
+ * Returns false if there is not enough data yet. */
+static inline bool parse_begin (const char* p, size_t len, bool final, state_t& state, mark_t* marks, size_t& i) {
+    if (!final && len < 2 && !(len == 1 && *p != '/')) return false;
+    memcpy(marks, initial_marks, sizeof(initial_marks));
     if (len >= 2 and *p == '/' and p[1] == '/') {
         state = STATE_HOST;
         i = 2;
         marks[STATE_HOST].start = marks[STATE_UINFO].start = i;
     }
-    else
+    else {
         state = STATE_SCHEME;
+        i = 0;
+    }
+    return true;
+}
+
+// with VALIDATE flag chars seen in every state must be allowed as is in these tables (or be percent-encoded)
+static const char* const valid_chars[STATE_END] = {
+    unsafe_path,  // STATE_SCHEME: it's not known yet whether it's a scheme (checked at ':') or the first part of path
+    unsafe_uinfo, // STATE_UINFO
+    unsafe_uinfo, // STATE_HOST: it may turn out to be user info
+    unsafe_uinfo, // STATE_HOST_IPV6
+    unsafe_uinfo, // STATE_PORT: it may turn out to be password (digits are checked at the end)
+    unsafe_path,  // STATE_PATH
+    unsafe_query, // STATE_QUERY
+    unsafe_fragment
+};
+
+static const URIView::part_t state_parts[STATE_END] = {
+    URIView::SCHEME, URIView::USER_INFO, URIView::HOST, URIView::HOST, URIView::PORT, URIView::PATH, URIView::QUERY, URIView::FRAGMENT
+};
+
+static inline void invalid (validation_t& v, size_t offset, URIView::part_t part) {
+    v.error      = offset;
+    v.error_part = part;
+}
+
+static inline bool validate_scheme (const char* p, size_t start, size_t end, validation_t& v) {
+    size_t bad = end;
+    if (start == end || !isalpha(p[start])) bad = start;
+    else for (size_t i = start + 1; i < end; ++i) if (unsafe_scheme[(uchar)p[i]] != p[i]) { bad = i; break; }
+    if (bad == end && start != end) return true;
+    invalid(v, bad, URIView::SCHEME);
+    return false;
+}
 
+/* Runs state machine over p[i..len). Returns position where it has stopped: 'len', position of null-byte (which should be treaten
+ * as the end of uri, 'stopped' is set then), or, unless 'final' is set, position of ':' after scheme if there is not enough
+ * data to see if it's followed by '//' */
+template <bool VALIDATE>
+static inline size_t parse_scan (const char* p, size_t i, size_t len, bool final, state_t& state, mark_t* marks, bool& stopped, validation_t& v) {
     for (; i < len; ++i) {
-        if (parseinfo[state][(uchar)p[i]].seen_state == STATE_NONE) continue;
-        if (unlikely(p[i] == 0)) break; // null-byte in uri should be treaten as the end of uri
+        if (parseinfo[state][(uchar)p[i]].seen_state == STATE_NONE) {
+            if (!VALIDATE) continue;
+            char c = p[i];
+            if (v.esc) {
+                if (!isxdigit(c)) { invalid(v, v.esc_start, state_parts[state]); stopped = true; break; }
+                --v.esc;
+            }
+            else if (c == '%') {
+                v.esc       = 2;
+                v.esc_start = i;
+            }
+            else if (valid_chars[state][(uchar)c] != c) { invalid(v, i, state_parts[state]); stopped = true; break; }
+            continue;
+        }
+        if (VALIDATE && v.esc) { invalid(v, v.esc_start, state_parts[state]); stopped = true; break; } // incomplete escape
+
+        if (unlikely(p[i] == 0)) { // null-byte in uri should be treaten as the end of uri (and is invalid)
+            if (VALIDATE) invalid(v, i, state_parts[state]);
+            stopped = true;
+            break;
+        }
 
         if (state == STATE_SCHEME && p[i] == ':') {                     // custom processing
+            if (!final && len <= i + 2) break;                          // wait for more data
+            if (VALIDATE && !validate_scheme(p, marks[STATE_SCHEME].start, i, v)) { stopped = true; break; }
+            marks[STATE_SCHEME].end = i;
             if (len > i + 2 && p[i+1] == '/' && p[i+2] == '/') {        // 'scheme://netloc' case
                 state = STATE_HOST;
-                _scheme.assign(p, i, string::COPY);
                 i += 2;
                 marks[STATE_HOST].start = marks[STATE_UINFO].start = i + 1;
             } else {                                                    // 'scheme:path' case
                 state = STATE_PATH;
-                _scheme.assign(p, i, string::COPY);
                 marks[STATE_PATH].start = i + 1;
             }
             continue;
@@ -187,40 +314,208 @@ void URI::parse (const string& uristr) {
 
         // default case
         token_t token = parseinfo[state][(uchar)p[i]];
+        if (VALIDATE && token.seen_state == STATE_UINFO && marks[STATE_UINFO].end >= 0) { // second '@'
+            invalid(v, i, URIView::HOST);
+            stopped = true;
+            break;
+        }
         marks[token.seen_state].end = i;
         state = token.next_state;
         if (state != STATE_END && !(token.flags & TF_SUBSTATE)) marks[state].start = i + (token.flags & TF_CROP ? 1 : 0);
     }
-    marks[parseinfo[state][0].seen_state].end = i;
+    return i;
+}
+
+static inline size_t parse_scan (const char* p, size_t i, size_t len, bool final, state_t& state, mark_t* marks, bool& stopped,
+                                  validation_t& v, int flags) {
+    if (flags & URI::VALIDATE) return parse_scan<true>(p, i, len, final, state, marks, stopped, v);
+    else                       return parse_scan<false>(p, i, len, final, state, marks, stopped, v);
+}
+
+static void throw_parse_error (const URIView& view) {
+    URIView::part_t part = view.error_part();
+    string offset = itoa(view.error_offset());
+    throw ParseError(std::string("URI: invalid ") + URIView::part_name(part) + " at offset " + std::string(offset.data(), offset.length()),
+                     view.error_offset(), part);
+}
+
+void URIView::parse (const char* p, size_t len, int flags) {
+    state_t      state;
+    mark_t       marks[STATE_END];
+    size_t       i;
+    bool         stopped = false;
+    validation_t v;
+    parse_begin(p, len, true, state, marks, i);
+    i = parse_scan(p, i, len, true, state, marks, stopped, v, flags);
+    set(p, len, i, state, marks, flags, v);
+}
+
+const char* URIView::part_name (part_t part) {
+    static const char* names[PARTS_COUNT] = {"scheme", "user_info", "host", "port", "path", "query", "fragment"};
+    return part < PARTS_COUNT ? names[part] : "";
+}
+
+void URIView::set (const char* p, size_t len, size_t end, state_t state, mark_t* marks, int flags, const validation_t& v) {
+    _str        = p;
+    _len        = len;
+    _port       = 0;
+    _error      = v.error;
+    _error_part = (part_t)v.error_part;
+    if (flags & URI::VALIDATE && _error < 0 && v.esc) { // incomplete escape at the end
+        _error      = v.esc_start;
+        _error_part = state_parts[state];
+    }
 
-    if (marks[STATE_UINFO].end > 0)
-        decode_uri_component(p + marks[STATE_UINFO].start, marks[STATE_UINFO].end - marks[STATE_UINFO].start, _user_info);
+    marks[parseinfo[state][0].seen_state].end = end;
+
+    if (flags & URI::ALLOW_LEADING_AUTHORITY && marks[STATE_HOST].end <= marks[STATE_HOST].start) guess_leading_authority(p, marks);
+
+    static const state_t part_states[PARTS_COUNT] = {STATE_SCHEME, STATE_UINFO, STATE_HOST, STATE_PORT, STATE_PATH, STATE_QUERY, STATE_FRAGMENT};
+    for (int n = 0; n < PARTS_COUNT; ++n) {
+        const mark_t& mark = marks[part_states[n]];
+        _spans[n].start  = mark.start;
+        _spans[n].length = mark.end > mark.start ? mark.end - mark.start : 0;
+    }
 
-    if (marks[STATE_HOST].end > 0) {
-        decode_uri_component(p + marks[STATE_HOST].start, marks[STATE_HOST].end - marks[STATE_HOST].start, _host);
-        if (marks[STATE_PORT].end > 0) {
-            const char* portp = p + marks[STATE_PORT].start;
-            size_t len = marks[STATE_PORT].end - marks[STATE_PORT].start;
-            for (size_t n = 0; n < len; ++n) {
-                char c = portp[n];
-                if (!unsafe_port[(uchar)c]) break;
-                _port = _port*10 + c - '0';
+    const char* portp = p + _spans[PORT].start;
+    if (flags & URI::VALIDATE && _error < 0) { // port must be all digits and fit in uint16_t
+        uint32_t port = 0;
+        for (size_t n = 0; n < _spans[PORT].length; ++n) {
+            char c = portp[n];
+            if (!unsafe_port[(uchar)c] || (port = port*10 + c - '0') > 65535) {
+                _error      = _spans[PORT].start + n;
+                _error_part = PORT;
+                break;
             }
         }
     }
 
-    if (marks[STATE_PATH].end > 0)
-        _path.assign(p + marks[STATE_PATH].start, marks[STATE_PATH].end - marks[STATE_PATH].start, string::COPY);
-    if (marks[STATE_QUERY].end > 0) { // assign as is, raw_query getter or parse_query will actually decode
-        _qstr.assign(p + marks[STATE_QUERY].start, marks[STATE_QUERY].end - marks[STATE_QUERY].start, string::COPY);
-        ok_qstr();
+    const char* hostp = p + _spans[HOST].start;
+    if (flags & URI::VALIDATE && _error < 0 && _spans[HOST].length && hostp[0] == '[') { // IP literal must be a valid address
+        char        buf[320];
+        size_t      hlen = _spans[HOST].length;
+        host_info_t info;
+        if (hlen < sizeof(buf)) decode_uri_component(hostp, hlen, buf, &hlen);
+        if (hlen >= sizeof(buf) || parse_host(buf, hlen, info) == HOST_INVALID) {
+            _error      = _spans[HOST].start;
+            _error_part = HOST;
+        }
     }
-    if (marks[STATE_FRAGMENT].end > 0)
-        _fragment.assign(p + marks[STATE_FRAGMENT].start, marks[STATE_FRAGMENT].end - marks[STATE_FRAGMENT].start, string::COPY);
 
-    if (_flags & ALLOW_LEADING_AUTHORITY && !_host.length()) guess_leading_authority();
+    for (size_t n = 0; n < _spans[PORT].length; ++n) {
+        char c = portp[n];
+        if (!unsafe_port[(uchar)c]) break;
+        _port = _port*10 + c - '0';
+    }
+}
+
+bool URIParser::feed (const char* data, size_t len) {
+    if (_max_length && _buf.length() + len > _max_length) return false;
+    if (_validation.error >= 0) return false;
+    if (_stopped || !len) return true;
+
+    // state to roll back to if the chunk turns out to be invalid
+    size_t       old_len     = _buf.length();
+    size_t       old_pos     = _pos;
+    bool         old_started = _started;
+    state_t      old_state   = _state;
+    validation_t old_v       = _validation;
+    mark_t       old_marks[STATE_END];
+    memcpy(old_marks, _marks, sizeof(_marks));
+
+    _buf.append(data, len);
+    const char* p = _buf.data();
+    size_t buflen = _buf.length();
+    if (!_started) {
+        if (!parse_begin(p, buflen, false, _state, _marks, _pos)) return true;
+        _started = true;
+    }
+    _pos = parse_scan(p, _pos, buflen, false, _state, _marks, _stopped, _validation, _flags);
+    if (_validation.error < 0) return true;
+
+    // the chunk is not taken, only the error is kept
+    _buf.resize(old_len);
+    _pos       = old_pos;
+    _started   = old_started;
+    _state     = old_state;
+    _stopped   = false;
+    old_v.error      = _validation.error;
+    old_v.error_part = _validation.error_part;
+    _validation      = old_v;
+    memcpy(_marks, old_marks, sizeof(_marks));
+    return false;
+}
+
+void URIParser::build (URI& uri) {
+    const char* p = _buf.data();
+    size_t len = _buf.length();
+    if (!_started) parse_begin(p, len, true, _state, _marks, _pos);
+    if (!_stopped) _pos = parse_scan(p, _pos, len, true, _state, _marks, _stopped, _validation, _flags);
+
+    URIView view;
+    view.set(p, len, _pos, _state, _marks, _flags, _validation);
+    if (!view.valid()) {
+        reset();
+        throw_parse_error(view);
+    }
+    uri._flags = _flags;
+    uri.set_parts(_buf, view);
+    reset();
+}
+
+void URIParser::finish (URI& uri) {
+    URI temp;
+    build(temp);
+    uri.assign(temp);
+}
+
+URI* URIParser::finish () {
+    URI temp;
+    build(temp);
+    return URI::create(temp);
+}
+
+uint16_t URIView::default_port () const {
+    URI::scheme_info_t* info = URI::find_scheme(_str + _spans[SCHEME].start, _spans[SCHEME].length);
+    return info ? info->default_port : 0;
+}
+
+URI* URIView::to_uri () const { return URI::create(*this); }
+
+void URI::parse (const string& uristr) {
+    PANDA_URI_STAT(parse, 1);
+    PANDA_URI_STAT(parse_bytes, uristr.length());
+    string src(uristr);
+    src.retain(); // make sure we own the buffer (not a reference to foreign memory), so that components can share it
+    URIView view(src.data(), src.length(), _flags);
+    if (!view.valid()) throw_parse_error(view);
+    set_parts(src, view);
+}
+
+void URI::set_parts (const string& src, const URIView& view) {
+    // components that need no decoding share the source buffer
+    URIView::span_t span;
+    if ((span = view.span(URIView::SCHEME)).length)    _scheme.assign(src, span.start, span.length);
+    if ((span = view.span(URIView::USER_INFO)).length) decode_uri_component(src, span.start, span.length, _user_info);
+    if ((span = view.span(URIView::HOST)).length) {
+        decode_uri_component(src, span.start, span.length, _host);
+        if (InternPool* pool = InternPool::current()) pool->intern(_host);
+    }
+    sync_host();
+    if ((span = view.span(URIView::PATH)).length)      _path.assign(src, span.start, span.length);
+    if ((span = view.span(URIView::QUERY)).length) { // assign as is, raw_query getter or parse_query will actually decode
+        _qstr.assign(src, span.start, span.length);
+        ok_qstr();
+    }
+    if ((span = view.span(URIView::FRAGMENT)).length)  _fragment.assign(src, span.start, span.length);
+    _port = view.explicit_port();
 
     sync_scheme_info();
+
+    // most likely to_string() will give the source back, it's checked on the first call
+    _str     = src;
+    _str_src = true;
+    _str_rev = _query.rev;
 }
 
 static inline void _encode_uri_component_append (const string& src, string& dest, const char* unsafe) {
@@ -229,7 +524,33 @@ static inline void _encode_uri_component_append (const string& src, string& dest
     dest.resize(dest.length() + final_size);
 }
 
-string URI::to_string (bool relative) const {
+void URI::sync_string () const {
+    bool   src = _str_src && _str_rev == _query.rev;
+    string str = build_string(false);
+    if (!src || _str != str) _str = str; // otherwise keep the source, it's shared with components
+    _str_src = false;
+    _str_rev = _query.rev;
+    PANDA_URI_STAT(to_string_bytes, _str.length());
+}
+
+static inline void hash_combine (uint64_t& h, const string& str) {
+    h ^= string_hash(str.data(), str.length()) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+void URI::sync_hash () const {
+    sync_query_string();
+    uint64_t h = port();
+    hash_combine(h, _scheme);
+    hash_combine(h, _user_info);
+    hash_combine(h, _host);
+    hash_combine(h, _path);
+    hash_combine(h, _qstr);
+    hash_combine(h, _fragment);
+    _hash     = h;
+    _hash_rev = _query.rev;
+}
+
+string URI::build_string (bool relative) const {
     sync_query_string();
     size_t approx_len = _path.length() + _fragment.length() + _qstr.length() + 3;
     if (!relative) approx_len += (_scheme.length()+3) + (_user_info.length()*3 + 1) + (_host.length()*3 + 6);
@@ -249,8 +570,8 @@ string URI::to_string (bool relative) const {
                 str += '@';
             }
 
-            if (_host[0] == '[' && _host[_host.length()-1] == ']') str += _host;
-            else _encode_uri_component_append(_host, str, unsafe_host);
+            bool ip_literal = _host[0] == '[' && _host[_host.length()-1] == ']';
+            _encode_uri_component_append(_host, str, ip_literal ? unsafe_ip_literal : unsafe_host);
 
             if (_port) {
                 str += ':';
@@ -275,73 +596,378 @@ string URI::to_string (bool relative) const {
     return str;
 }
 
+size_t URI::remove_dot_segments (char* path, size_t len) {
+    size_t i = 0, o = 0; // input and output positions, output never outruns input
+    while (i < len) {
+        size_t left = len - i;
+        const char* p = path + i;
+        if (left >= 3 && p[0] == '.' && p[1] == '.' && p[2] == '/') i += 3;                          // "../"
+        else if (left >= 2 && p[0] == '.' && p[1] == '/') i += 2;                                    // "./"
+        else if (left >= 3 && p[0] == '/' && p[1] == '.' && p[2] == '/') i += 2;                     // "/./" -> "/"
+        else if (left == 2 && p[0] == '/' && p[1] == '.') {                                          // "/." at the end -> "/"
+            path[o++] = '/';
+            break;
+        }
+        else if ((left >= 4 && p[0] == '/' && p[1] == '.' && p[2] == '.' && p[3] == '/') ||        // "/../" -> "/" and pop
+                 (left == 3 && p[0] == '/' && p[1] == '.' && p[2] == '.')) {                       // "/.." at the end -> "/" and pop
+            while (o && path[o-1] != '/') --o;
+            if (o) --o;
+            if (left == 3) {
+                path[o++] = '/';
+                break;
+            }
+            i += 3;
+        }
+        else if ((left == 1 && p[0] == '.') || (left == 2 && p[0] == '.' && p[1] == '.')) break;   // "." or ".."
+        else do path[o++] = path[i++]; while (i < len && path[i] != '/');                           // move the first segment
+    }
+    return o;
+}
+
+static inline bool has_dot_segments (const char* path, size_t len) {
+    for (size_t start = 0; start < len; ) {
+        const char* end = (const char*)memchr(path + start, '/', len - start);
+        size_t slen = (end ? end - path : len) - start;
+        if ((slen == 1 && path[start] == '.') || (slen == 2 && path[start] == '.' && path[start+1] == '.')) return true;
+        if (!end) break;
+        start = end - path + 1;
+    }
+    return false;
+}
+
+// normalizes escapes and, if 'path' is true, removes dot segments of a component in place. Doesn't touch it if nothing changes
+static void normalize_component (string& str, bool path = false) {
+    size_t len = str.length();
+    const char* p = str.data();
+    const char* pct = (const char*)memchr(p, '%', len);
+    bool dots = path && has_dot_segments(p, len);
+    if (!pct && !dots) return;
+
+    if (pct) {
+        // skip escapes which are already normal
+        size_t i = pct - p;
+        char tmp[3];
+        for (; i + 2 < len; ++i) {
+            if (p[i] != '%' || !isxdigit(p[i+1]) || !isxdigit(p[i+2])) continue;
+            if (normalize_uri_escapes(p + i, 3, tmp) != 3 || memcmp(tmp, p + i, 3)) break;
+            i += 2;
+        }
+        if (i + 2 >= len) i = len;
+        if (i == len && !dots) return;
+    }
+
+    char* buf = str.buf();
+    len = normalize_uri_escapes(buf, len, buf);
+    if (path) len = URI::remove_dot_segments(buf, len);
+    str.resize(len);
+}
+
+// for encoded host: lowercases all but hex digits of escapes
+static inline size_t lowercase_host (char* p, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (p[i] == '%') i += 2; // hex digits of escapes stay uppercased
+        else if (p[i] >= 'A' && p[i] <= 'Z') p[i] |= 0x20;
+    }
+    return len;
+}
+
+struct qparam_t {
+    const char* str;
+    size_t      len;
+    size_t      klen;
+    bool operator< (const qparam_t& p) const {
+        int cmp = memcmp(str, p.str, std::min(klen, p.klen));
+        return cmp ? cmp < 0 : klen < p.klen;
+    }
+};
+
+/* Stable sort of query params by key. Writes result to 'dest' (which must not overlap with 'src') and returns false,
+ * or returns true without writing anything if params are already sorted. Allocates only for queries with a lot of params. */
+static bool query_sorted (const char* src, size_t len, char delim, char* dest) {
+    const size_t STACK_PARAMS = 32;
+    qparam_t stack_params[STACK_PARAMS];
+    std::vector<qparam_t> heap_params;
+    qparam_t* params = stack_params;
+    size_t cnt = std::count(src, src + len, delim) + 1;
+    if (cnt > STACK_PARAMS) {
+        heap_params.resize(cnt);
+        params = &heap_params[0];
+    }
+
+    bool sorted = true;
+    const char* p = src;
+    const char* end = src + len;
+    for (size_t i = 0; i < cnt; ++i) {
+        const char* pend = (const char*)memchr(p, delim, end - p);
+        if (!pend) pend = end;
+        const char* eq = (const char*)memchr(p, '=', pend - p);
+        params[i].str  = p;
+        params[i].len  = pend - p;
+        params[i].klen = (eq ? eq : pend) - p;
+        if (i && params[i] < params[i-1]) sorted = false;
+        p = pend + 1;
+    }
+    if (sorted) return true;
+
+    if (cnt <= STACK_PARAMS) { // insertion sort, as std::stable_sort allocates
+        for (size_t i = 1; i < cnt; ++i) {
+            qparam_t cur = params[i];
+            size_t j = i;
+            for (; j && cur < params[j-1]; --j) params[j] = params[j-1];
+            params[j] = cur;
+        }
+    }
+    else std::stable_sort(params, params + cnt);
+
+    for (size_t i = 0; i < cnt; ++i) {
+        if (i) *dest++ = delim;
+        memcpy(dest, params[i].str, params[i].len);
+        dest += params[i].len;
+    }
+    return false;
+}
+
+void URI::normalize (bool sort_query) {
+    changed();
+    // scheme is always kept lowercased
+    // host is stored decoded, so there are no escapes to skip (unlike in the encoded output of lowercase_host())
+    size_t hlen = _host.length();
+    const char* h = _host.data();
+    for (size_t i = 0; i < hlen; ++i) if (h[i] >= 'A' && h[i] <= 'Z') {
+        char* p = _host.buf();
+        for (; i < hlen; ++i) if (p[i] >= 'A' && p[i] <= 'Z') p[i] |= 0x20;
+        break;
+    }
+
+    if (_port && _port == default_port()) _port = 0;
+
+    normalize_component(_path, true);
+    normalize_component(_fragment);
+
+    sync_query_string();
+    normalize_component(_qstr);
+    if (sort_query && _qstr.length()) {
+        const char delim = _flags & PARAM_DELIM_SEMICOLON ? ';' : '&';
+        string sorted;
+        if (!query_sorted(_qstr.data(), _qstr.length(), delim, sorted.reserve(_qstr.length()))) {
+            sorted.resize(_qstr.length());
+            _qstr = sorted;
+            ok_qstr(); // parsed query may be in original order
+        }
+    }
+}
+
+string URI::normalized_string (bool sort_query) const {
+    sync_query_string();
+    size_t qlen = _qstr.length();
+    size_t approx_len = (_scheme.length()+3) + (_user_info.length()*3 + 1) + (_host.length()*3 + 6) + _path.length() +
+                        _fragment.length() + qlen + 3;
+    if (sort_query) approx_len += qlen; // scratch space for sorting
+    string str;
+    char* buf = str.reserve(approx_len);
+    char* p = buf;
+    size_t len;
+
+    if (_scheme.length()) {
+        memcpy(p, _scheme.data(), _scheme.length());
+        p += _scheme.length();
+        *p++ = ':';
+        if (_host.length()) { *p++ = '/'; *p++ = '/'; }
+    }
+    else if (_host.length()) { *p++ = '/'; *p++ = '/'; }
+
+    if (_host.length()) {
+        if (_user_info.length()) {
+            encode_uri_component(_user_info, p, &len, unsafe_uinfo);
+            p += len;
+            *p++ = '@';
+        }
+
+        bool ip_literal = _host[0] == '[' && _host[_host.length()-1] == ']';
+        encode_uri_component(_host, p, &len, ip_literal ? unsafe_ip_literal : unsafe_host);
+        p += lowercase_host(p, len);
+
+        uint16_t port = _port == default_port() ? 0 : _port;
+        if (port) {
+            *p++ = ':';
+            string sport = itoa(port);
+            memcpy(p, sport.data(), sport.length());
+            p += sport.length();
+        }
+    }
+
+    len = normalize_uri_escapes(_path.data(), _path.length(), p);
+    p += remove_dot_segments(p, len);
+
+    if (qlen) {
+        *p++ = '?';
+        char* q = p;
+        len = normalize_uri_escapes(_qstr.data(), qlen, q);
+        if (sort_query) {
+            // sort from query written to the scratch space after it into its place
+            char* scratch = q + qlen;
+            memcpy(scratch, q, len);
+            query_sorted(scratch, len, _flags & PARAM_DELIM_SEMICOLON ? ';' : '&', q);
+        }
+        p += len;
+    }
+
+    if (_fragment.length()) {
+        *p++ = '#';
+        p += normalize_uri_escapes(_fragment.data(), _fragment.length(), p);
+    }
+
+    str.resize(p - buf);
+    return str;
+}
+
+void URI::resolve (const URI& base) {
+    changed();
+    if (_scheme.length()) {
+        if (has_dot_segments(_path.data(), _path.length())) _path.resize(remove_dot_segments(_path.buf(), _path.length()));
+        return;
+    }
+
+    if (!_host.length()) {
+        size_t plen = _path.length();
+        if (!plen) {
+            _path = base._path;
+            if (!query_string().length()) {
+                _qstr = base.query_string();
+                ok_qstr();
+            }
+        }
+        else if (_path[0] == '/') {
+            if (has_dot_segments(_path.data(), plen)) _path.resize(remove_dot_segments(_path.buf(), plen));
+        }
+        else {
+            // merge: base path up to the last '/' (or just '/' if base has authority and empty path) + reference path
+            size_t blen = base._path.length();
+            const char* bp = base._path.data();
+            while (blen && bp[blen-1] != '/') --blen;
+            bool root = !blen && base._host.length();
+            size_t prefix = root ? 1 : blen;
+
+            char* buf = _path.reserve(prefix + plen); // reuses our buffer if possible
+            memmove(buf + prefix, buf, plen);
+            if (root) *buf = '/';
+            else      memcpy(buf, bp, blen);
+            _path.resize(remove_dot_segments(buf, prefix + plen));
+        }
+
+        _user_info = base._user_info;
+        _host      = base._host;
+        _host_info = base._host_info;
+        _port      = base._port;
+    }
+    else if (has_dot_segments(_path.data(), _path.length())) _path.resize(remove_dot_segments(_path.buf(), _path.length()));
+
+    _scheme     = base._scheme;
+    scheme_info = base.scheme_info;
+}
+
 void URI::parse_query () const {
+    bool str_ok  = _str_rev == _query.rev; // query string doesn't change, so neither do to_string() and hash()
+    bool hash_ok = _hash_rev == _query.rev;
     enum { PARSE_MODE_KEY, PARSE_MODE_VAL, PARSE_MODE_WRITE } mode = PARSE_MODE_KEY;
     int key_start = 0;
     int key_end   = 0;
     int val_start = 0;
     const char delim = _flags & PARAM_DELIM_SEMICOLON ? ';' : '&';
-    const char* str = _qstr.c_str();
+    const char* str = _qstr.data();
     int len = _qstr.length();
+    InternPool* pool = InternPool::current();
+    PANDA_URI_STAT(parse_query_bytes, len);
     _query.clear();
-
-    if (len) for (int i = 0; i <= len; ++i) {
-        char c = (i == len) ? delim : str[i];
-        if (c == '=' && mode == PARSE_MODE_KEY) {
-            key_end = i;
-            mode = PARSE_MODE_VAL;
-            val_start = i+1;
-        }
-        else if (c == delim) {
-            if (mode == PARSE_MODE_KEY) {
+    _query.keep_order(_flags & QUERY_KEEP_ORDER);
+    if (len) {
+        Query::container_type& items = _query._mut();
+        items.reserve(std::count(str, str + len, delim) + 1);
+        for (int i = 0; i <= len; ++i) {
+            char c = (i == len) ? delim : str[i];
+            if (c == '=' && mode == PARSE_MODE_KEY) {
                 key_end = i;
-                val_start = i;
+                mode = PARSE_MODE_VAL;
+                val_start = i+1;
+            }
+            else if (c == delim) {
+                if (mode == PARSE_MODE_KEY) {
+                    key_end = i;
+                    val_start = i;
+                }
+
+                items.push_back(Query::value_type());
+                Query::value_type& elem = items.back();
+
+                size_t klen = key_end - key_start;
+                if (klen > 0) {
+                    decode_uri_component(_qstr, key_start, klen, elem.first);
+                    if (pool) pool->intern(elem.first);
+                }
+
+                size_t vlen = i - val_start;
+                if (vlen > 0) decode_uri_component(_qstr, val_start, vlen, elem.second);
+
+                mode = PARSE_MODE_KEY;
+                key_start = i+1;
             }
-
-            string key;
-            size_t klen = key_end - key_start;
-            if (klen > 0) decode_uri_component(str+key_start, klen, key);
-
-            Query::iterator elem = _query.insert(key, string());
-
-            size_t vlen = i - val_start;
-            if (vlen > 0) decode_uri_component(str+val_start, vlen, elem->second);
-
-            mode = PARSE_MODE_KEY;
-            key_start = i+1;
         }
     }
 
+    _query._restore_order();
     ok_qboth();
+    if (str_ok) _str_rev = _query.rev;
+    if (hash_ok) _hash_rev = _query.rev;
 }
 
-void URI::compile_query () const {
-    _qstr.clear();
+size_t URI::scan_query (const string& key, string* val, std::vector<string>* vals) const {
     const char delim = _flags & PARAM_DELIM_SEMICOLON ? ';' : '&';
-    Query::const_iterator begin = _query.begin();
-    Query::const_iterator end   = _query.end();
-
-    size_t bufsize = 0;
-    for (Query::const_iterator it = begin; it != end; ++it) {
-        bufsize += (it->first.length() + it->second.length())*3 + 2;
-    }
-    if (bufsize) --bufsize;
+    const char* str = _qstr.data();
+    size_t len = _qstr.length();
+    if (!len) return 0;
+
+    size_t found = 0;
+    string decoded_key;
+    for (size_t start = 0;; ) {
+        const char* delimp = (const char*)memchr(str + start, delim, len - start);
+        size_t end = delimp ? delimp - str : len;
+        const char* eqp = (const char*)memchr(str + start, '=', end - start);
+        size_t key_end = eqp ? eqp - str : end;
+        size_t klen = key_end - start;
+
+        // encoded key is never shorter than decoded one, so decode key only if it has escapes and might match
+        bool match = false;
+        if (klen >= key.length()) {
+            size_t pos = find_uri_escape(str + start, klen);
+            if (pos == klen) match = klen == key.length() && !memcmp(str + start, key.data(), klen);
+            else {
+                _decode_uri_component(str + start, klen, pos, decoded_key);
+                match = decoded_key == key;
+            }
+        }
 
-    _qstr.reserve(bufsize);
+        if (match) {
+            ++found;
+            string value;
+            if (eqp && end > key_end + 1) decode_uri_component(_qstr, key_end + 1, end - key_end - 1, value);
+            if (!vals) {
+                if (val) *val = value;
+                return found;
+            }
+            vals->push_back(value);
+        }
 
-    char* bufp = _qstr.buf();
-    char* ptr = bufp;
-    size_t len;
-    for (Query::const_iterator it = begin; it != end; ++it) {
-        if (it != begin) *ptr++ = delim;
-        encode_uri_component(it->first, ptr, &len);
-        ptr += len;
-        *ptr++ = '=';
-        encode_uri_component(it->second, ptr, &len);
-        ptr += len;
+        if (end == len) break;
+        start = end + 1;
     }
-    _qstr.resize(ptr-bufp);
 
+    return found;
+}
+
+void URI::compile_query () const {
+    _qstr.clear();
+    encode_query(_query.cbegin(), _query.cend(), _qstr, query_delim());
+    PANDA_URI_STAT(qstr_sync_bytes, _qstr.length());
     ok_qboth();
 }
 
@@ -371,6 +997,7 @@ const std::vector<string> URI::path_segments () const {
 }
 
 void URI::path_segments (const std::vector<string>& list) {
+    changed();
     _path.clear();
     for (size_t i = 0; i < list.size(); ++i) {
         if (!list[i].size()) continue;
@@ -1,14 +1,22 @@
 #pragma once
-#include <map>
 #include <vector>
 #include <cctype>
+#include <algorithm>
+#include <functional>
 #include <typeinfo>
 #include <stdexcept>
 #include <panda/lib.h>
 #include <panda/refcnt.h>
 #include <panda/string.h>
+#include <panda/uri/Arena.h>
 #include <panda/uri/Query.h>
+#include <panda/uri/stats.h>
 #include <panda/uri/encode.h>
+#include <panda/uri/host.h>
+#include <panda/uri/InternPool.h>
+#include <panda/uri/PublicSuffix.h>
+#include <panda/uri/URIView.h>
+#include <panda/uri/URIParser.h>
 
 namespace panda { namespace uri {
 
@@ -27,12 +35,21 @@ public:
   explicit WrongScheme (const std::string& what_arg) : URIError(what_arg) {}
 };
 
+class ParseError : public URIError {
+public:
+  ParseError (const std::string& what_arg, size_t offset, URIView::part_t part) : URIError(what_arg), offset(offset), part(part) {}
+  size_t          offset;
+  URIView::part_t part;
+};
+
 class URI : public virtual panda::RefCounted {
 
 public:
     enum flags_t {
         ALLOW_LEADING_AUTHORITY = 1, // allow urls to begin with authority (i.e. 'google.com', 'login@mysite.com:8080/mypath', etc (but NOT with IPV6 [xx:xx:...])
         PARAM_DELIM_SEMICOLON   = 2, // allow query string param to be delimiter by ';' rather than '&'
+        QUERY_KEEP_ORDER        = 4, // keep query params in original order rather than sorting them by key (see Query)
+        VALIDATE                = 8, // validate chars of every component and percent-escapes while parsing, throw ParseError if url is invalid
     };
 
     class Strict;
@@ -45,22 +62,40 @@ public:
 
     typedef URI* (*uricreator) (const URI& uri);
 
-    static void register_scheme (const string& scheme, const std::type_info*, uricreator, uint16_t default_port, bool secure = false);
+    static int register_scheme (const string& scheme, const std::type_info*, uricreator, uint16_t default_port, bool secure = false);
+
+    static int scheme_index (const string& scheme) {
+        scheme_info_t* info = find_scheme(scheme.data(), scheme.length());
+        return info ? info->index : -1;
+    }
+
+    // opaque per-scheme data of language bindings (perl class for XS wrappers), kept across re-registration of the scheme
+    static void scheme_binding (int index, void* data);
 
     static URI* create (const string& source, int flags = 0) {
         URI temp(source, flags);
-        if (temp.scheme_info) return temp.scheme_info->creator(temp);
-        else                  return new URI(temp);
+        if (temp.scheme_info && temp.scheme_info->creator) return temp.scheme_info->creator(temp);
+        else                                                return new URI(temp);
     }
 
     static URI* create (const URI& source) {
-        if (source.scheme_info) return source.scheme_info->creator(source);
-        else                    return new URI(source);
+        if (source.scheme_info && source.scheme_info->creator) return source.scheme_info->creator(source);
+        else                                                    return new URI(source);
     }
 
-    URI ()                                    : scheme_info(NULL), _port(0), _qrev(1), _flags(0)     {}
-    URI (const string& source, int flags = 0) : scheme_info(NULL), _port(0), _qrev(1), _flags(flags) { parse(source); }
-    URI (const URI& source)                                                                          { assign(source); }
+    static URI* create (const URIView& view, int flags = 0) {
+        URI temp(view, flags);
+        return create(temp);
+    }
+
+    URI ()                                    : scheme_info(NULL), _port(0), _qrev(1), _str_src(false), _str_rev(0), _hash_rev(0), _flags(0)     {}
+    URI (const string& source, int flags = 0) : scheme_info(NULL), _port(0), _qrev(1), _str_src(false), _str_rev(0), _hash_rev(0), _flags(flags) { parse(source); }
+    URI (const URI& source)                   : _str_src(false), _str_rev(0), _hash_rev(0)                                         { assign(source); }
+
+    // promotes view without parsing it again. Flags only matter for the query (view has already been parsed with its own flags)
+    URI (const URIView& view, int flags = 0) : scheme_info(NULL), _port(0), _qrev(1), _str_src(false), _str_rev(0), _hash_rev(0), _flags(flags) {
+        set_parts(string(view.data(), view.length(), string::COPY), view);
+    }
 
     URI& operator= (const URI& source)    { if (this != &source) assign(source); return *this; }
     URI& operator= (const string& source) { assign(source); return *this; }
@@ -74,19 +109,53 @@ public:
     uint16_t      default_port  () const { return scheme_info ? scheme_info->default_port : 0; }
     uint16_t      port          () const { return _port ? _port : default_port(); }
     bool          secure        () const { return scheme_info ? scheme_info->secure : false; }
+    int           scheme_index  () const { return scheme_info ? scheme_info->index : -1; }
+    void*         scheme_binding() const { return scheme_info ? scheme_info->binding : NULL; }
+    int           flags         () const { return _flags; }
+
+    /* Host is classified whenever it changes. Addresses are binary (network byte order) and are only valid if host is of that type,
+     * zone id of IPv6 address shares host's buffer. */
+    host_type_t     host_type () const { return (host_type_t)_host_info.type; }
+    const in_addr*  host_ipv4 () const { return _host_info.type == HOST_IPV4 ? &_host_info.addr.v4 : NULL; }
+    const in6_addr* host_ipv6 () const { return _host_info.type == HOST_IPV6 ? &_host_info.addr.v6 : NULL; }
+    string          host_zone () const {
+        string ret;
+        if (_host_info.zone_len) ret.assign(_host, _host_info.zone_start, _host_info.zone_len);
+        return ret;
+    }
+    char          query_delim   () const { return _flags & PARAM_DELIM_SEMICOLON ? ';' : '&'; }
+
+    /* Public suffix ("co.uk") and registrable domain ("example.co.uk") of the host by the Public Suffix List, see PublicSuffix.h.
+     * Without an argument the list from PublicSuffix::instance() is used. Both share host's buffer and are empty if host is not a
+     * registered name, or no list is loaded; registrable domain is also empty if host itself is a public suffix. */
+    string public_suffix      () const;
+    string public_suffix      (const PublicSuffix& list) const;
+    string registrable_domain () const;
+    string registrable_domain (const PublicSuffix& list) const;
 
     virtual void assign (const URI& source) {
         _scheme     = source._scheme;
         scheme_info = source.scheme_info;
         _user_info  = source._user_info;
         _host       = source._host;
+        _host_info  = source._host_info;
         _path       = source._path;
         _qstr       = source._qstr;
         _query      = source._query;
-        _qrev       = source._qrev;
+        _qrev       = source._qrev ? (source._qrev == source._query.rev ? _query.rev : _query.rev - 1) : 0; // revs are per object
         _fragment   = source._fragment;
         _port       = source._port;
         _flags      = source._flags;
+        if (source._str_rev && source._str_rev == source._query.rev) {
+            _str     = source._str;
+            _str_src = source._str_src;
+            _str_rev = _query.rev;
+        }
+        else changed();
+        if (source._hash_rev && source._hash_rev == source._query.rev) {
+            _hash     = source._hash;
+            _hash_rev = _query.rev;
+        }
     }
 
     void assign (const string& uristr, int flags = 0) {
@@ -120,14 +189,16 @@ public:
     virtual void scheme (const string& scheme) {
         _scheme.assign(scheme);
         sync_scheme_info();
+        changed();
     }
 
-    void user_info (const string& user_info) { _user_info.assign(user_info); }
-    void host      (const string& host)      { _host.assign(host); }
-    void fragment  (const string& fragment)  { _fragment.assign(fragment); }
-    void port      (uint16_t port)           { _port = port; }
+    void user_info (const string& user_info) { _user_info.assign(user_info); changed(); }
+    void host      (const string& host)      { _host.assign(host); sync_host(); changed(); }
+    void fragment  (const string& fragment)  { _fragment.assign(fragment);   changed(); }
+    void port      (uint16_t port)           { _port = port;                 changed(); }
 
     void path (const string& path) {
+        changed();
         if (path.length() > 0 && path[0] != '/') {
             _path.assign(1, '/');
             _path.append(path);
@@ -138,27 +209,31 @@ public:
     void query_string (const string& qstr) {
         _qstr.assign(qstr);
         ok_qstr();
+        changed();
     }
 
     void raw_query (const string& rq) {
         _qstr.clear();
         encode_uri_component(rq, _qstr, unsafe_query);
         ok_qstr();
+        changed();
     }
 
     void query (const string& qstr) { query_string(qstr); }
     void query (const Query& query) {
         _query = query;
         ok_query();
+        changed();
     }
 
     void add_query (const string& addstr) {
         if (!addstr.length()) return;
         sync_query_string();
         ok_qstr();
+        changed();
         if (_qstr.length() > 0) {
             _qstr.reserve(_qstr.length() + addstr.length() + 1);
-            _qstr.append(1, '&');
+            _qstr.append(1, query_delim());
             _qstr.append(addstr);
         } else {
             _qstr.assign(addstr);
@@ -167,17 +242,46 @@ public:
 
     void add_query (const Query& addquery);
 
-    const string& param (const string& key) const {
-        sync_query();
-        Query::const_iterator row = _query.find(key);
-        return row == _query.cend() ? _empty : row->second;
+    string param (const string& key) const {
+        string ret;
+        find_param(key, ret);
+        return ret;
+    }
+
+    /* These methods don't parse query string into Query if it hasn't been done yet. Instead, they scan query string for 'key',
+     * and decode only the values of params found. */
+    bool find_param (const string& key, string& val) const {
+        if (has_ok_query()) {
+            Query::const_iterator row = _query.find(key);
+            if (row == _query.cend()) return false;
+            val = row->second;
+            return true;
+        }
+        return scan_query(key, &val, NULL);
+    }
+
+    size_t multiparam (const string& key, std::vector<string>& vals) const {
+        if (!has_ok_query()) return scan_query(key, NULL, &vals);
+        Query::const_pair range = _query.equal_range(key);
+        for (Query::const_iterator it = range.first; it != range.second; ++it) vals.push_back(it->second);
+        return range.second - range.first;
+    }
+
+    size_t nparam () const {
+        if (has_ok_query()) return _query.size();
+        if (!_qstr.length()) return 0;
+        return std::count(_qstr.data(), _qstr.data() + _qstr.length(), query_delim()) + 1;
     }
 
     void param (const string& key, const string& val) {
         sync_query();
-        Query::iterator row = _query.find(key);
-        if (row != _query.end()) row->second.assign(val); 
-        else _query.insert(key, val);
+        const Query& cquery = _query; // don't unshare params unless the value changes
+        Query::const_iterator crow = cquery.find(key);
+        if (crow == cquery.cend()) _query.insert(key, val);
+        else if (crow->second != val) {
+            _query.find(key)->second.assign(val);
+            _query.touch();
+        }
     }
 
     string explicit_location () const {
@@ -204,10 +308,12 @@ public:
     }
 
     void location (const string& newloc) {
+        changed();
         size_t len = newloc.length();
         if (!len) {
             _host.clear();
             _port = 0;
+            sync_host();
             return;
         }
 
@@ -221,78 +327,163 @@ public:
                 _port = std::strtol(newloc.data() + delim + 1, NULL, 10);
             }
         }
+        sync_host();
     }
 
     const std::vector<string> path_segments () const;
     void path_segments (const std::vector<string>& list);
 
-    string to_string (bool relative = false) const;
+    /* Absolute form is cached until the object is changed, so repeated calls only share the buffer. Just parsed and never changed
+     * uri returns its source string if it serializes to the same thing. */
+    string to_string (bool relative = false) const {
+        if (relative) return build_string(true);
+        PANDA_URI_STAT(to_string, 1);
+        if (!has_ok_str()) sync_string();
+        else PANDA_URI_STAT(to_string_hits, 1);
+        return _str;
+    }
     string relative  () const { return to_string(true); }
 
+    /* RFC 3986 6.2.2 syntax-based normalization: lowercases scheme and host, uppercases percent-escapes, decodes escaped unreserved
+     * chars, removes dot segments from path and drops default port. Optionally sorts query params by key.
+     * Components are only touched (and therefore detached from shared buffers) if they actually change. */
+    void   normalize         (bool sort_query = false);
+    string normalized_string (bool sort_query = false) const; // same as normalize() + to_string() but doesn't change the object
+
+    static size_t remove_dot_segments (char* path, size_t len); // RFC 3986 5.2.4, in place, returns new length
+
+    /* RFC 3986 5.2 reference resolution, done on parsed components of 'base' (it's not serialized or reparsed).
+     * The first one resolves this uri as a reference against 'base' in place, the second one sets this uri to 'ref' resolved
+     * against 'base' ('ref' is parsed with base's flags). Components taken from base share its buffers.
+     * As uri doesn't distinguish between undefined and empty components, empty host/query are treated as undefined. */
+    void resolve (const URI& base);
+    void resolve (const URI& base, const string& ref) {
+        assign(ref, base._flags);
+        resolve(base);
+    }
+
+    /* Hash of the same components equals() compares (so that uris which differ only in explicit default port have the same hash).
+     * It's cached until the uri is changed */
+    uint64_t hash () const {
+        if (!has_ok_hash()) sync_hash();
+        return _hash;
+    }
+
     bool equals (const URI& uri) const {
-        if (_path != uri._path || _host != uri._host || _user_info != uri._user_info || _fragment != uri._fragment || _scheme != uri._scheme) return false;
+        if (has_ok_hash() && uri.has_ok_hash() && _hash != uri._hash) return false;
+        if (!same(_path, uri._path) || !same(_host, uri._host) || !same(_user_info, uri._user_info) || !same(_fragment, uri._fragment) ||
+            !same(_scheme, uri._scheme)) return false;
         if (_port != uri._port && port() != uri.port()) return false;
         sync_query_string();
         uri.sync_query_string();
-        return _qstr == uri._qstr;
+        return same(_qstr, uri._qstr);
     }
 
     void swap (URI& uri) {
+        // revs are counted per Query object, so states synced with query revs are moved to a new rev, common for both objects
+        uint32_t rev = std::max(_query.rev, uri._query.rev) + 1;
+        rebase_rev(rev);
+        uri.rebase_rev(rev);
+        _query.swap(uri._query);
+        _query.rev = uri._query.rev = rev;
+
         std::swap(_scheme,     uri._scheme);
         std::swap(scheme_info, uri.scheme_info);
         std::swap(_user_info,  uri._user_info);
         std::swap(_host,       uri._host);
+        std::swap(_host_info,  uri._host_info);
         std::swap(_port,       uri._port);
         std::swap(_path,       uri._path);
         std::swap(_qstr,       uri._qstr);
-        std::swap(_query,      uri._query);
         std::swap(_qrev,       uri._qrev);
         std::swap(_fragment,   uri._fragment);
         std::swap(_flags,      uri._flags);
+        std::swap(_str,        uri._str);
+        std::swap(_str_src,    uri._str_src);
+        std::swap(_str_rev,    uri._str_rev);
+        std::swap(_hash,       uri._hash);
+        std::swap(_hash_rev,   uri._hash_rev);
     }
 
     virtual ~URI () {}
 
+    // uri objects come from the current arena if there is an active Arena::Scope (see Arena.h), or from thread-local free lists
+    static void* operator new    (size_t size)    { return allocate(size); }
+    static void  operator delete (void* ptr)      { deallocate(ptr); }
+
 protected:
     struct scheme_info_t {
         int        index;
-        string     scheme;
+        string     scheme; // lowercased
+        uint32_t   hash;
         uricreator creator;
         uint16_t   default_port;
         bool       secure;
         const std::type_info* type_info;
+        void* volatile        binding;
     };
-    typedef std::map<const string, scheme_info_t*> SchemeMap;
-    typedef std::map<uint64_t, scheme_info_t*> SchemeTIMap;
     typedef std::vector<scheme_info_t*> SchemeVector;
 
     scheme_info_t* scheme_info;
 
-    static SchemeMap    scheme_map;
-    static SchemeTIMap  scheme_ti_map;
     static SchemeVector schemas;
 
+    static const size_t SCHEME_TABLE_SIZE = 256; // power of 2
+    static const size_t BUILTIN_SCHEMES   = 8;   // max length of builtin scheme + 1
+    static scheme_info_t* volatile scheme_table[SCHEME_TABLE_SIZE];
+    static scheme_info_t* volatile builtin_schemes[BUILTIN_SCHEMES]; // first registered scheme of every length
+    static scheme_info_t* volatile scheme_ti_table[SCHEME_TABLE_SIZE]; // by name of type_info, for strict classes
+    static volatile int            scheme_lock;
+
+    static scheme_info_t* find_scheme (const char* scheme, size_t len); // case-insensitive
+    static scheme_info_t* find_scheme (const std::type_info* ti);
+
     virtual void parse (const string& uristr);
 
 private:
     string           _scheme;
     string           _user_info;
     string           _host;
+    host_info_t      _host_info;
     string           _path;
     string           _fragment;
     uint16_t         _port;
     mutable string   _qstr;
     mutable Query    _query;
     mutable uint32_t _qrev; // last query rev we've synced query string with (0 if query itself isn't synced with string)
+    mutable string   _str;     // cached to_string()
+    mutable bool     _str_src; // _str is the source string uri has been parsed from, not yet compared with what to_string() builds
+    mutable uint32_t _str_rev; // query rev _str is valid for (0 if it's not valid)
+    mutable uint64_t _hash;
+    mutable uint32_t _hash_rev; // same as _str_rev for _hash
     int              _flags;
 
-    static const string _empty;
+
+    friend class URIView;
+    friend class URIParser;
+    friend class PackedURI;
 
     void ok_qstr      () const { _qrev = 0; }
     void ok_query     () const { _qrev = _query.rev - 1; }
     void ok_qboth     () const { _qrev = _query.rev; }
     bool has_ok_qstr  () const { return !_qrev || _qrev == _query.rev; }
     bool has_ok_query () const { return _qrev != 0; }
+    bool has_ok_str   () const { return _str_rev && _str_rev == _query.rev && !_str_src; }
+    bool has_ok_hash  () const { return _hash_rev && _hash_rev == _query.rev; }
+
+    // strings sharing one buffer (interned ones or parts of the same source) are equal without comparing bytes
+    static bool same (const string& a, const string& b) {
+        return a.length() == b.length() && (a.data() == b.data() || !memcmp(a.data(), b.data(), a.length()));
+    }
+
+    // every change of components (except for changes of query via Query object, which are tracked by its rev) must call this
+    void changed () { _str_rev = _hash_rev = 0; }
+
+    void rebase_rev (uint32_t rev) {
+        if (_qrev) _qrev = _qrev == _query.rev ? rev : rev - 1;
+        _str_rev  = _str_rev  == _query.rev ? rev : 0;
+        _hash_rev = _hash_rev == _query.rev ? rev : 0;
+    }
 
     void clear () {
         _port = 0;
@@ -300,21 +491,38 @@ private:
         scheme_info = NULL;
         _user_info.clear();
         _host.clear();
+        _host_info = host_info_t();
         _path.clear();
         _qstr.clear();
         _query.clear();
         _fragment.clear();
         ok_qboth();
+        changed();
         _flags = 0;
     }
 
-    inline void guess_leading_authority ();
+    void set_parts (const string& src, const URIView& view);
+
+    void sync_host () { parse_host(_host.data(), _host.length(), _host_info); }
 
-    void compile_query () const;
-    void parse_query   () const;
+    string build_string  (bool relative) const;
+    void   sync_string   () const;
+    void   sync_hash     () const;
+    void   compile_query () const;
+    void   parse_query   () const;
+    size_t scan_query    (const string& key, string* val, std::vector<string>* vals) const;
 
-    void sync_query_string () const { if (!has_ok_qstr()) compile_query(); }
-    void sync_query        () const { if (!has_ok_query()) parse_query(); }
+    void sync_query_string () const {
+        PANDA_URI_STAT(qstr_sync, 1);
+        if (!has_ok_qstr()) compile_query();
+        else PANDA_URI_STAT(qstr_sync_hits, 1);
+    }
+
+    void sync_query () const {
+        PANDA_URI_STAT(query_sync, 1);
+        if (!has_ok_query()) parse_query();
+        else PANDA_URI_STAT(query_sync_hits, 1);
+    }
 
     void sync_scheme_info () {
         size_t len = _scheme.length();
@@ -323,13 +531,16 @@ private:
             return;
         }
 
-        // lowercase the scheme
-        char* p = _scheme.buf();
-        for (size_t i = 0; i < len; i++) p[i] = tolower(p[i]);
+        // lowercase the scheme, not touching the buffer (which may be shared with the source string) if it's already lowercased
+        const char* cp = _scheme.data();
+        size_t i = 0;
+        while (i < len && !isupper(cp[i])) ++i;
+        if (i < len) {
+            char* p = _scheme.buf();
+            for (; i < len; i++) p[i] = tolower(p[i]);
+        }
 
-        SchemeMap::iterator it = scheme_map.find(_scheme);
-        if (it == scheme_map.end()) scheme_info = NULL;
-        else                        scheme_info = it->second;
+        scheme_info = find_scheme(_scheme.data(), len);
     }
 };
 
@@ -339,3 +550,11 @@ inline bool operator!= (const URI& lhs, const URI& rhs) { return !lhs.equals(rhs
 inline void swap (URI& l, URI& r) { l.swap(r); }
 
 }}
+
+#if __cplusplus >= 201103L
+namespace std {
+    template <> struct hash<panda::uri::URI> {
+        size_t operator() (const panda::uri::URI& uri) const { return uri.hash(); }
+    };
+}
+#endif
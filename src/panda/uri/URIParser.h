@@ -0,0 +1,62 @@
+#pragma once
+#include <panda/string.h>
+#include <panda/uri/URIView.h>
+
+namespace panda { namespace uri {
+
+using panda::string;
+
+class URI;
+
+/* Incremental url parser for urls coming in chunks (for example, request targets split across network reads).
+ * Chunks are appended to internal buffer and the state machine runs over each chunk as it arrives, keeping its state between
+ * calls, so nothing is rescanned. finish() produces the same uri as one-shot parsing of the whole string would, and the uri
+ * shares the internal buffer (no copying). After finish() parser is ready for the next url. */
+class URIParser {
+public:
+    explicit URIParser (int flags = 0, size_t max_length = 0) : _flags(flags), _max_length(max_length) { reset(); }
+
+    void reset () {
+        _buf.clear();
+        _pos        = 0;
+        _started    = false;
+        _stopped    = false;
+        _validation = validation_t();
+    }
+
+    void reset (int flags) {
+        _flags = flags;
+        reset();
+    }
+
+    /* returns false (and doesn't take the chunk) if buffered url would become longer than 'max_length' (if it's not 0),
+     * or, with URI::VALIDATE flag, if the chunk makes url invalid (see error_offset(), the offset may be past the buffered data).
+     * Once url is invalid, all chunks are rejected and finish() throws until reset() */
+    bool feed (const char* data, size_t len);
+    bool feed (const string& data) { return feed(data.data(), data.length()); }
+
+    // these throw ParseError if url is invalid (with URI::VALIDATE flag)
+    void finish (URI& uri); // sets parsed url into 'uri' (which may be strict and throw if scheme doesn't match)
+    URI* finish ();         // creates uri like URI::create() does
+
+    bool    valid        () const { return _validation.error < 0; }
+    ssize_t error_offset () const { return _validation.error; }
+    size_t  length       () const { return _buf.length(); }
+    size_t  max_length   () const { return _max_length; }
+    int     flags        () const { return _flags; }
+
+private:
+    int     _flags;
+    size_t  _max_length;
+    string  _buf;
+    size_t  _pos;     // position the state machine has scanned up to
+    bool    _started; // initial state has been chosen
+    bool    _stopped; // null-byte has been seen, the rest is ignored
+    state_t _state;
+    mark_t  _marks[STATE_END];
+    validation_t _validation;
+
+    void build (URI& uri); // runs the rest of state machine and sets components into empty 'uri'
+};
+
+}}
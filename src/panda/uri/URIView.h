@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <panda/string.h>
+
+namespace panda { namespace uri {
+
+using panda::string;
+
+class URI;
+class URIParser;
+class PackedURI;
+
+// states of url parser's state machine (see URI.cc)
+enum state_t {
+    STATE_NONE   = -1,
+    STATE_SCHEME = 0,
+    STATE_UINFO,
+    STATE_HOST,
+    STATE_HOST_IPV6,
+    STATE_PORT,
+    STATE_PATH,
+    STATE_QUERY,
+    STATE_FRAGMENT,
+    STATE_END
+};
+
+// position of component in source string, end is -1 if component hasn't been seen
+struct mark_t {
+    ssize_t start;
+    ssize_t end;
+};
+
+// state of chars validation (with URI::VALIDATE flag), kept between calls by URIParser
+struct validation_t {
+    int     esc;        // number of hex digits of current percent-escape still expected
+    size_t  esc_start;  // offset of current percent-escape
+    ssize_t error;      // offset of the first invalid char or -1
+    int     error_part; // URIView::part_t
+    validation_t () : esc(0), esc_start(0), error(-1), error_part(0) {}
+};
+
+/* Non-owning parse result: offsets of url components in the caller's buffer, which must outlive the view.
+ * It is filled by the same state machine as URI and makes no allocations at all. Components are returned as is (not decoded),
+ * as string objects referencing the caller's buffer. */
+class URIView {
+public:
+    enum part_t {
+        SCHEME = 0,
+        USER_INFO,
+        HOST,
+        PORT,
+        PATH,
+        QUERY,
+        FRAGMENT,
+        PARTS_COUNT
+    };
+
+    struct span_t {
+        size_t start;
+        size_t length;
+    };
+
+    URIView ()                                           : _str(NULL), _len(0), _port(0), _error(-1), _error_part(SCHEME) { clear_spans(); }
+    URIView (const char* str, size_t len, int flags = 0)                                                      { parse(str, len, flags); }
+    explicit URIView (const string& str, int flags = 0)                                                       { parse(str.data(), str.length(), flags); }
+
+    void parse (const char* str, size_t len, int flags = 0);
+
+    string   scheme        () const { return part(SCHEME); }
+    string   user_info     () const { return part(USER_INFO); }
+    string   host          () const { return part(HOST); }
+    string   path          () const { return part(PATH); }
+    string   query_string  () const { return part(QUERY); }
+    string   fragment      () const { return part(FRAGMENT); }
+    uint16_t explicit_port () const { return _port; }
+    uint16_t default_port  () const;
+    uint16_t port          () const { return _port ? _port : default_port(); }
+
+    string part (part_t part) const { return string(_str + _spans[part].start, _spans[part].length, string::REF); }
+    span_t span (part_t part) const { return _spans[part]; }
+
+    const char* data   () const { return _str; }
+    size_t      length () const { return _len; }
+
+    URI* to_uri () const; // same as URI::create(view)
+
+    // with URI::VALIDATE flag parsing stops at the first invalid char, view is not valid then
+    bool    valid        () const { return _error < 0; }
+    ssize_t error_offset () const { return _error; }
+    part_t  error_part   () const { return _error_part; }
+
+    static const char* part_name (part_t part);
+
+private:
+    friend class URIParser;
+    friend class PackedURI;
+
+    const char* _str;
+    size_t      _len;
+    span_t      _spans[PARTS_COUNT];
+    uint16_t    _port;
+    ssize_t     _error;
+    part_t      _error_part;
+
+    void clear_spans () { for (int i = 0; i < PARTS_COUNT; ++i) _spans[i].start = _spans[i].length = 0; }
+
+    // sets spans from parser's marks, 'end' is the position where parsing has stopped in 'state'
+    void set (const char* str, size_t len, size_t end, state_t state, mark_t* marks, int flags, const validation_t& v);
+};
+
+}}
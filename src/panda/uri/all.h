@@ -1,3 +1,5 @@
 #pragma once
 #include <panda/uri/ftp.h>
 #include <panda/uri/http.h>
+#include <panda/uri/PackedURI.h>
+#include <panda/uri/Router.h>
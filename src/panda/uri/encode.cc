@@ -1,7 +1,13 @@
 #include <climits>
+#include <cstring>
 #include <panda/uri/encode.h>
 #include <panda/lib.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(PANDA_URI_NO_SIMD)
+#  define PANDA_URI_SIMD_X86
+#  include <immintrin.h>
+#endif
+
 namespace panda { namespace uri {
 
 #define FROM_HEX(ch) (std::isdigit(ch) ? ch - '0' : std::tolower(ch) - 'a' + 10)
@@ -10,24 +16,151 @@ typedef unsigned char uchar;
 char unsafe_scheme[256];
 char unsafe_uinfo[256];
 char unsafe_host[256];
+char unsafe_ip_literal[256];
 char unsafe_path[256];
 char unsafe_path_segment[256];
 char unsafe_query[256];
 char unsafe_query_component[256];
+char unsafe_query_component_plus[256];
 char unsafe_fragment[256];
 
 static char _restore[256];
 static char _forward[256][2];
 static char _backward[256][2];
 
+static inline char* encode_char (char* buf, uchar uc, const char* unsafe) {
+    if (likely(unsafe[uc] != 0)) *buf++ = unsafe[uc];
+    else {
+        *buf++ = '%';
+        *buf++ = _forward[uc][0];
+        *buf++ = _forward[uc][1];
+    }
+    return buf;
+}
+
+#ifdef PANDA_URI_SIMD_X86
+
+/* Vector kernels classify 16/32 bytes at once via nibble lookup: lut[low nibble] has bit N set if char (N << 4 | low nibble)
+ * passes through 'unsafe' table unchanged. Chars >= 0x80 are never passed as is, so 8 bits are enough.
+ * Lookup tables are built at startup for the built-in 'unsafe' tables only. Custom tables belong to the caller, who may regenerate
+ * or free them at any time, so they are always encoded by the scalar loop. */
+typedef char* (*encode_kernel_t) (const char* src, size_t srclen, size_t* pos, char* buf, const char* unsafe, const uchar* lut);
+
+static const char* const simd_unsafe[] = {
+    unsafe_scheme, unsafe_uinfo, unsafe_host, unsafe_ip_literal, unsafe_path, unsafe_path_segment, unsafe_query,
+    unsafe_query_component, unsafe_query_component_plus, unsafe_fragment
+};
+static const size_t    SIMD_TABLES = sizeof(simd_unsafe) / sizeof(simd_unsafe[0]);
+static uchar           simd_luts[SIMD_TABLES][16];
+static encode_kernel_t encode_kernel;
+
+static inline const uchar* simd_table (const char* unsafe) {
+    for (size_t i = 0; i < SIMD_TABLES; ++i) if (simd_unsafe[i] == unsafe) return simd_luts[i];
+    return NULL;
+}
+
+// encodes a run of chars starting with src[i] which is known to need encoding, stops on the first char that passes as is
+static inline char* encode_unsafe_run (const char* src, size_t srclen, size_t& i, char* buf, const char* unsafe) {
+    do buf = encode_char(buf, src[i++], unsafe);
+    while (i < srclen && unsafe[(uchar)src[i]] != src[i]);
+    return buf;
+}
+
+/* Kernels store the whole vector to dest and then advance past its safe prefix, so that the rest gets overwritten.
+ * It never writes past the end of dest, as dest must have room for srclen*3 bytes and vectors are only stored while
+ * there are at least 16 source bytes left. */
+
+__attribute__((target("ssse3")))
+static char* encode_ssse3 (const char* src, size_t srclen, size_t* pos, char* buf, const char* unsafe, const uchar* lut) {
+    const __m128i vlut  = _mm_loadu_si128((const __m128i*)lut);
+    const __m128i vbits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i vlow  = _mm_set1_epi8(0x0f);
+    size_t i = *pos;
+    while (i + 16 <= srclen) {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_and_si128(v, vlow);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), vlow);
+        __m128i ok = _mm_and_si128(_mm_shuffle_epi8(vlut, lo), _mm_shuffle_epi8(vbits, hi));
+        unsigned bad = _mm_movemask_epi8(_mm_cmpeq_epi8(ok, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i*)buf, v);
+        if (!bad) { i += 16; buf += 16; continue; }
+        unsigned n = __builtin_ctz(bad);
+        i += n;
+        buf = encode_unsafe_run(src, srclen, i, buf + n, unsafe);
+    }
+    *pos = i;
+    return buf;
+}
+
+__attribute__((target("avx2")))
+static char* encode_avx2 (const char* src, size_t srclen, size_t* pos, char* buf, const char* unsafe, const uchar* lut) {
+    const __m256i vlut  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)lut));
+    const __m256i vbits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i vlow  = _mm256_set1_epi8(0x0f);
+    size_t i = *pos;
+    while (i + 32 <= srclen) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_and_si256(v, vlow);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), vlow);
+        __m256i ok = _mm256_and_si256(_mm256_shuffle_epi8(vlut, lo), _mm256_shuffle_epi8(vbits, hi));
+        unsigned bad = _mm256_movemask_epi8(_mm256_cmpeq_epi8(ok, _mm256_setzero_si256()));
+        _mm256_storeu_si256((__m256i*)buf, v);
+        if (!bad) { i += 32; buf += 32; continue; }
+        unsigned n = __builtin_ctz(bad);
+        i += n;
+        buf = encode_unsafe_run(src, srclen, i, buf + n, unsafe);
+    }
+    *pos = i;
+    return encode_ssse3(src, srclen, pos, buf, unsafe, lut); // 16-31 bytes left
+}
+
+/* Escape search kernels return either the position of the first '%' or '+', or the position where less than a whole vector
+ * of bytes is left to check */
+
+typedef size_t (*find_kernel_t) (const char* src, size_t srclen);
+
+static find_kernel_t find_kernel;
+
+__attribute__((target("sse2")))
+static size_t find_escape_sse2 (const char* src, size_t srclen) {
+    const __m128i vpct  = _mm_set1_epi8('%');
+    const __m128i vplus = _mm_set1_epi8('+');
+    size_t i = 0;
+    for (; i + 16 <= srclen; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        unsigned found = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, vpct), _mm_cmpeq_epi8(v, vplus)));
+        if (found) return i + __builtin_ctz(found);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t find_escape_avx2 (const char* src, size_t srclen) {
+    const __m256i vpct  = _mm256_set1_epi8('%');
+    const __m256i vplus = _mm256_set1_epi8('+');
+    size_t i = 0;
+    for (; i + 32 <= srclen; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        unsigned found = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, vpct), _mm256_cmpeq_epi8(v, vplus)));
+        if (found) return i + __builtin_ctz(found);
+    }
+    return i + find_escape_sse2(src + i, srclen - i);
+}
+
+#endif
+
 static int init () {
     unsafe_generate(unsafe_scheme, UNSAFE_ALPHA|UNSAFE_DIGIT, "+-.");
     unsafe_generate(unsafe_uinfo, UNSAFE_UNRESERVED | UNSAFE_SUBDELIMS, ":");
     unsafe_generate(unsafe_host, UNSAFE_UNRESERVED | UNSAFE_SUBDELIMS);
+    unsafe_generate(unsafe_ip_literal, UNSAFE_UNRESERVED | UNSAFE_SUBDELIMS, ":[]");
     unsafe_generate(unsafe_path, UNSAFE_PCHAR, "/");
     unsafe_generate(unsafe_path_segment, UNSAFE_PCHAR);
     unsafe_generate(unsafe_query, UNSAFE_PCHAR, "/?");
     unsafe_generate(unsafe_query_component, UNSAFE_UNRESERVED);
+    unsafe_generate(unsafe_query_component_plus, UNSAFE_UNRESERVED);
+    unsafe_query_component_plus[(uchar)' '] = '+';
     unsafe_generate(unsafe_fragment, UNSAFE_PCHAR, "/?");
 
     static char hex[] = "0123456789ABCDEF";
@@ -44,35 +177,76 @@ static int init () {
     _restore[(uchar)'%'] = 0;
     _restore[(uchar)'+'] = ' ';
 
+    #ifdef PANDA_URI_SIMD_X86
+    __builtin_cpu_init();
+    if      (__builtin_cpu_supports("avx2"))  encode_kernel = encode_avx2;
+    else if (__builtin_cpu_supports("ssse3")) encode_kernel = encode_ssse3;
+    if      (__builtin_cpu_supports("avx2"))  find_kernel = find_escape_avx2;
+    else if (__builtin_cpu_supports("sse2"))  find_kernel = find_escape_sse2;
+    for (size_t i = 0; i < SIMD_TABLES; ++i)
+        for (int c = 1; c < 128; ++c) if (simd_unsafe[i][c] == c) simd_luts[i][c & 15] |= 1 << (c >> 4);
+    #endif
+
     return 0;
 }
 static int __init = init();
 
 char* encode_uri_component (const char* src, size_t srclen, char* dest, size_t* destlen, const char* unsafe) {
+    PANDA_URI_STAT(encode, 1);
+    PANDA_URI_STAT(encode_bytes, srclen);
     char* buf = dest;
-    for (int i = 0; i < srclen; ++i) {
-        uchar uc = src[i];
-        if (likely(unsafe[uc] != 0)) *buf++ = unsafe[uc];
-        else {
-            *buf++ = '%';
-            *buf++ = _forward[uc][0];
-            *buf++ = _forward[uc][1];
-        }
+    size_t i = 0;
+
+    #ifdef PANDA_URI_SIMD_X86
+    if (srclen >= 16 && encode_kernel) {
+        const uchar* lut = simd_table(unsafe);
+        if (lut) buf = encode_kernel(src, srclen, &i, buf, unsafe, lut); // leaves less than 16 bytes for the loop below
     }
+    #endif
+
+    for (; i < srclen; ++i) buf = encode_char(buf, src[i], unsafe);
 
     *buf = 0;
     *destlen = buf - dest;
     return dest;
 }
 
+size_t find_uri_escape (const char* src, size_t srclen) {
+    size_t i = 0;
+
+    #ifdef PANDA_URI_SIMD_X86
+    if (srclen >= 16 && find_kernel) i = find_kernel(src, srclen);
+    #endif
+
+    for (; i < srclen; ++i) if (_restore[(uchar)src[i]] != src[i]) break;
+    return i;
+}
+
 char* decode_uri_component (const char* src, size_t srclen, char* dest, size_t* destlen) {
+    PANDA_URI_STAT(decode, 1);
+    PANDA_URI_STAT(decode_bytes, srclen);
     char* buf = dest;
-    for (int i = 0; i < srclen; ++i) {
-        char res = _restore[(uchar)src[i]];
-        if (likely(res != 0)) *buf++ = res;
-        else if (i < srclen-2) {
-            *buf++ = _backward[(uchar)src[i+1]][0] | _backward[(uchar)src[i+2]][1];
-            i += 2;
+    size_t i = 0;
+    while (i < srclen) {
+        size_t clean = find_uri_escape(src + i, srclen - i);
+        memcpy(buf, src + i, clean);
+        buf += clean;
+        i   += clean;
+
+        // escapes usually come in groups (utf-8 chars, etc), so process them here until the next clean char
+        while (i < srclen) {
+            if (src[i] == '+') {
+                *buf++ = ' ';
+                ++i;
+            }
+            else if (src[i] == '%') {
+                if (i + 2 < srclen) {
+                    *buf++ = _backward[(uchar)src[i+1]][0] | _backward[(uchar)src[i+2]][1];
+                    i += 3;
+                }
+                else ++i; // incomplete escape at the end, just drop '%'
+            }
+            else break;
         }
     }
 
@@ -81,4 +255,24 @@ char* decode_uri_component (const char* src, size_t srclen, char* dest, size_t*
     return dest;
 }
 
+size_t normalize_uri_escapes (const char* src, size_t srclen, char* dest) {
+    char* buf = dest;
+    for (size_t i = 0; i < srclen; ++i) {
+        char c = src[i];
+        if (c != '%' || i + 2 >= srclen || !std::isxdigit(src[i+1]) || !std::isxdigit(src[i+2])) {
+            *buf++ = c;
+            continue;
+        }
+        uchar uc = _backward[(uchar)src[i+1]][0] | _backward[(uchar)src[i+2]][1];
+        if (uc && unsafe_query_component[uc] == (char)uc) *buf++ = uc; // unreserved char
+        else {
+            *buf++ = '%';
+            *buf++ = _forward[uc][0];
+            *buf++ = _forward[uc][1];
+        }
+        i += 2;
+    }
+    return buf - dest;
+}
+
 }}
@@ -1,5 +1,7 @@
 #pragma once
+#include <cstring>
 #include <panda/string.h>
+#include <panda/uri/stats.h>
 using panda::string;
 
 namespace panda { namespace uri {
@@ -15,14 +17,20 @@ static const int UNSAFE_PCHAR      = 64;
 extern char unsafe_scheme[256];
 extern char unsafe_uinfo[256];
 extern char unsafe_host[256];
+extern char unsafe_ip_literal[256]; // host in brackets: only '%' of IPv6 zone id is escaped
 extern char unsafe_path[256];
 extern char unsafe_path_segment[256];
 extern char unsafe_query[256];
 extern char unsafe_query_component[256];
+extern char unsafe_query_component_plus[256]; // the same, but space is encoded as '+'
 extern char unsafe_fragment[256];
 
-char* encode_uri_component (const char* src, size_t srclen, char* dest, size_t* destlen, const char* unsafe = unsafe_query_component);
-char* decode_uri_component (const char* src, size_t srclen, char* dest, size_t* destlen);
+char*  encode_uri_component (const char* src, size_t srclen, char* dest, size_t* destlen, const char* unsafe = unsafe_query_component);
+char*  decode_uri_component (const char* src, size_t srclen, char* dest, size_t* destlen);
+size_t find_uri_escape      (const char* src, size_t srclen); // position of the first '%' or '+', srclen if nothing to decode
+
+// uppercases hex digits of escapes and decodes escaped unreserved chars (RFC 3986 6.2.2), dest may be the same as src
+size_t normalize_uri_escapes (const char* src, size_t srclen, char* dest);
 
 inline void encode_uri_component (const char* src, size_t srclen, string& dest, const char* unsafe = unsafe_query_component) {
     size_t final_size;
@@ -30,10 +38,40 @@ inline void encode_uri_component (const char* src, size_t srclen, string& dest,
     dest.resize(final_size);
 }
 
-inline void decode_uri_component (const char* src, size_t srclen, string& dest) {
+// decodes src which is known to have something to decode starting from 'pos'
+inline void _decode_uri_component (const char* src, size_t srclen, size_t pos, string& dest) {
     size_t final_size;
-    decode_uri_component(src, srclen, dest.reserve(srclen), &final_size);
-    dest.resize(final_size);
+    char* buf = dest.reserve(srclen);
+    memcpy(buf, src, pos);
+    decode_uri_component(src + pos, srclen - pos, buf + pos, &final_size);
+    dest.resize(pos + final_size);
+}
+
+// returns false if src had nothing to decode (and therefore was just copied)
+inline bool decode_uri_component (const char* src, size_t srclen, string& dest) {
+    size_t pos = find_uri_escape(src, srclen);
+    if (pos == srclen) {
+        PANDA_URI_STAT(decode, 1);
+        PANDA_URI_STAT(decode_skips, 1);
+        dest.assign(src, srclen, string::COPY);
+        return false;
+    }
+    _decode_uri_component(src, srclen, pos, dest);
+    return true;
+}
+
+// decodes 'len' bytes of src starting from 'start'. If they have nothing to decode, dest just shares src's buffer and false is returned
+inline bool decode_uri_component (const string& src, size_t start, size_t len, string& dest) {
+    const char* p = src.data() + start;
+    size_t pos = find_uri_escape(p, len);
+    if (pos == len) {
+        PANDA_URI_STAT(decode, 1);
+        PANDA_URI_STAT(decode_skips, 1);
+        dest.assign(src, start, len);
+        return false;
+    }
+    _decode_uri_component(p, len, pos, dest);
+    return true;
 }
 
 inline void encode_uri_component (const string& src, char* dest, size_t* destlen, const char* unsafe = unsafe_query_component) {
@@ -48,8 +86,32 @@ inline void encode_uri_component (const string& src, string& dest, const char* u
     encode_uri_component(src.data(), src.length(), dest, unsafe);
 }
 
-inline void decode_uri_component (const string& src, string& dest) {
-    decode_uri_component(src.data(), src.length(), dest);
+inline bool decode_uri_component (const string& src, string& dest) {
+    return decode_uri_component(src.data(), src.length(), dest);
+}
+
+/* Encodes params from a range of pairs (Query, std::map<string,string>, std::vector<std::pair<string,string> >, etc: anything
+ * whose 'first' and 'second' have data() and length()) straight into query string, appending them to 'dest' separated by 'delim'
+ * (and separated from what dest already has). The range is walked twice: the buffer is sized first, so it's allocated only once. */
+template <class ForwardIterator>
+void encode_query (ForwardIterator first, ForwardIterator last, string& dest, char delim = '&') {
+    if (first == last) return;
+    size_t len     = dest.length();
+    size_t bufsize = len + 1;
+    for (ForwardIterator it = first; it != last; ++it) bufsize += (it->first.length() + it->second.length())*3 + 2;
+
+    char* buf = dest.reserve(bufsize);
+    char* ptr = buf + len;
+    size_t elen;
+    for (ForwardIterator it = first; it != last; ++it) {
+        if (ptr != buf) *ptr++ = delim;
+        encode_uri_component(it->first.data(), it->first.length(), ptr, &elen);
+        ptr += elen;
+        *ptr++ = '=';
+        encode_uri_component(it->second.data(), it->second.length(), ptr, &elen);
+        ptr += elen;
+    }
+    dest.resize(ptr - buf);
 }
 
 inline void unsafe_generate (char* unsafe, int flags, const char* chars = NULL) {
@@ -0,0 +1,64 @@
+#include <cctype>
+#include <cstring>
+#include <arpa/inet.h>
+#include <panda/uri/host.h>
+#include <panda/uri/encode.h>
+
+namespace panda { namespace uri {
+
+typedef unsigned char uchar;
+
+// IPvFuture = "v" 1*HEXDIG "." 1*( unreserved / sub-delims / ":" )
+static bool is_ipvfuture (const char* p, size_t len) {
+    size_t i = 1;
+    while (i < len && isxdigit((uchar)p[i])) ++i;
+    if (i == 1 || i >= len - 1 || p[i] != '.') return false;
+    for (++i; i < len; ++i) if (unsafe_uinfo[(uchar)p[i]] != p[i]) return false; // unreserved, sub-delims and ':'
+    return true;
+}
+
+host_type_t parse_host (const char* host, size_t len, host_info_t& info) {
+    info.zone_start = info.zone_len = 0;
+    char buf[INET6_ADDRSTRLEN];
+
+    if (!len) return (host_type_t)(info.type = HOST_NONE);
+
+    if (host[0] != '[') {
+        info.type = HOST_REG_NAME;
+        if (len < 7 || len > 15 || !isdigit((uchar)host[0])) return HOST_REG_NAME; // cheap check for typical names
+        memcpy(buf, host, len);
+        buf[len] = 0;
+        if (inet_pton(AF_INET, buf, &info.addr.v4) == 1) info.type = HOST_IPV4;
+        return (host_type_t)info.type;
+    }
+
+    info.type = HOST_INVALID;
+    if (len < 3 || host[len-1] != ']') return HOST_INVALID;
+    const char* p = host + 1;
+    size_t      n = len - 2;
+
+    if (p[0] == 'v' || p[0] == 'V') {
+        if (is_ipvfuture(p, n)) info.type = HOST_IPVFUTURE;
+        return (host_type_t)info.type;
+    }
+
+    const char* zone = (const char*)memchr(p, '%', n);
+    if (zone) {
+        size_t zlen = p + n - zone - 1;
+        if (!zlen || zone + 1 - host > 255 || zlen > 255) return HOST_INVALID;
+        info.zone_start = zone + 1 - host;
+        info.zone_len   = zlen;
+        n = zone - p;
+    }
+    if (n >= sizeof(buf)) {
+        info.zone_start = info.zone_len = 0;
+        return HOST_INVALID;
+    }
+    memcpy(buf, p, n);
+    buf[n] = 0;
+    if (inet_pton(AF_INET6, buf, &info.addr.v6) == 1) info.type = HOST_IPV6;
+    else info.zone_start = info.zone_len = 0;
+    return (host_type_t)info.type;
+}
+
+}}
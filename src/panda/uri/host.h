@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <netinet/in.h>
+
+namespace panda { namespace uri {
+
+enum host_type_t {
+    HOST_NONE      = 0, // empty host
+    HOST_REG_NAME  = 1, // registered name (to be resolved via DNS)
+    HOST_IPV4      = 2, // dotted-decimal IPv4 address
+    HOST_IPV6      = 3, // [IPv6 address], maybe with zone id (RFC 6874)
+    HOST_IPVFUTURE = 4, // [vX.something]
+    HOST_INVALID   = 5  // bracketed host that is neither IPv6 nor IPvFuture
+};
+
+/* Result of host classification. Addresses are in network byte order, ready for sockaddr structs. Zone id is kept as the position
+ * of its first char and length in host string (after '%'). */
+struct host_info_t {
+    host_info_t () : type(HOST_NONE), zone_start(0), zone_len(0) {}
+
+    uint8_t  type;
+    uint8_t  zone_start;
+    uint8_t  zone_len;
+    union {
+        in_addr  v4;
+        in6_addr v6;
+    } addr;
+};
+
+/* Classifies host as URI keeps it (decoded, IP literal in brackets) and fills binary address for IPv4/IPv6.
+ * Doesn't allocate. Dotted-decimal IPv4 must be exactly 4 decimal octets without leading zeros (RFC 3986 3.2.2), otherwise
+ * it's a registered name. */
+host_type_t parse_host (const char* host, size_t len, host_info_t& info);
+
+}}
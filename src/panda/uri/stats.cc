@@ -0,0 +1,16 @@
+#include <cstring>
+#include <panda/uri/stats.h>
+
+namespace panda { namespace uri {
+
+#ifdef PANDA_URI_STATS
+__thread stats_t _stats;
+const stats_t& stats () { return _stats; }
+void reset_stats () { memset(&_stats, 0, sizeof(_stats)); }
+#else
+static const stats_t _zero = stats_t();
+const stats_t& stats () { return _zero; }
+void reset_stats () {}
+#endif
+
+}}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+namespace panda { namespace uri {
+
+/* Counters of hot paths, per thread. They are compiled in only if the library is built with -DPANDA_URI_STATS, otherwise
+ * PANDA_URI_STAT() expands to nothing and stats() always returns zeros. "hits" are calls served from the cache without any work,
+ * the rest of calls are misses. */
+struct stats_t {
+    uint64_t parse;              // URI::parse() calls
+    uint64_t parse_bytes;        // and length of the source strings
+    uint64_t to_string;          // URI::to_string() calls (absolute form)
+    uint64_t to_string_hits;     // served from the cached string
+    uint64_t to_string_bytes;    // length of strings built on misses
+    uint64_t query_sync;         // accesses to the parsed query
+    uint64_t query_sync_hits;    // when it's up to date with the query string
+    uint64_t parse_query_bytes;  // length of query strings parsed on misses
+    uint64_t qstr_sync;          // accesses to the query string
+    uint64_t qstr_sync_hits;     // when it's up to date with the parsed query
+    uint64_t qstr_sync_bytes;    // length of query strings compiled on misses
+    uint64_t query_hv_sync;      // XSURI::query_hv() calls (perl's $uri->query)
+    uint64_t query_hv_sync_hits; // when the perl hash is up to date
+    uint64_t encode;             // encode_uri_component() calls, including internal ones
+    uint64_t encode_bytes;       // and input bytes
+    uint64_t decode;             // decode_uri_component() calls, including internal ones
+    uint64_t decode_skips;       // when there was nothing to decode and the source was just shared or copied
+    uint64_t decode_bytes;       // input bytes of calls which actually decoded
+};
+
+const stats_t& stats       (); // counters of the current thread
+void           reset_stats ();
+
+#ifdef PANDA_URI_STATS
+extern __thread stats_t _stats;
+#  define PANDA_URI_STAT(name, n) (panda::uri::_stats.name += (n))
+#else
+#  define PANDA_URI_STAT(name, n) ((void)0)
+#endif
+
+}}
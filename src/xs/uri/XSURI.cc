@@ -1,3 +1,5 @@
+#include <vector>
+#include <algorithm>
 #include <xs/lib.h>
 #include <panda/lib.h>
 #include <xs/uri/XSURI.h>
@@ -6,53 +8,94 @@ namespace xs { namespace uri {
 
 using xs::lib::sv2string;
 using panda::uri::Query;
-using panda::lib::string_hash;
-
-XSURI::UriClassMap XSURI::uri_class_map;
+using panda::uri::encode_uri_component;
 
 void XSURI::register_perl_scheme (const char* scheme, const char* perl_class) {
-    uri_class_map[string_hash(scheme)] = newSVpvn_share(perl_class, strlen(perl_class), 0);
+    int idx = URI::scheme_index(scheme);
+    if (idx < 0) idx = URI::register_scheme(scheme, NULL, NULL, 0); // perl-only scheme, just reserve an index for it
+    URI::scheme_binding(idx, newSVpvn_share(perl_class, strlen(perl_class), 0));
 }
 
 SV* XSURI::get_perl_class (const URI* uri) {
     static SV* default_perl_class = newSVpvs_share("Panda::URI");
-    UriClassMap::iterator it = uri_class_map.find(string_hash(uri->scheme().data(), uri->scheme().length()));
-    if (it == uri_class_map.end()) return default_perl_class;
-    else return it->second;
+    SV* perl_class = (SV*)uri->scheme_binding();
+    return perl_class ? perl_class : default_perl_class;
+}
+
+static inline size_t sv_length (SV* sv) {
+    if (!SvOK(sv)) return 0;
+    STRLEN len;
+    SvPV(sv, len);
+    return len;
+}
+
+static inline char* encode_sv (SV* sv, char* ptr) {
+    if (!SvOK(sv)) return ptr;
+    STRLEN len;
+    const char* str = SvPV(sv, len);
+    size_t elen;
+    encode_uri_component(str, len, ptr, &elen);
+    return ptr + elen;
+}
+
+static inline char* encode_param (const char* key, I32 klen, SV* val, char* ptr, char* buf, char delim) {
+    if (ptr != buf) *ptr++ = delim;
+    size_t elen;
+    encode_uri_component(key, klen, ptr, &elen);
+    ptr += elen;
+    *ptr++ = '=';
+    return val ? encode_sv(val, ptr) : ptr;
 }
 
-static void hv2query (HV* hvquery, Query* query) {
-    I32 size = hv_iterinit(hvquery);
-    char* keystr;
-    I32 keylen;
-    for (int i = 0; i < size; ++i) {
-        SV* valueSV = hv_iternextsv(hvquery, &keystr, &keylen);
-        string key(keystr, keylen, string::COPY);
-
-        if (SvROK(valueSV) && SvTYPE(SvRV(valueSV)) == SVt_PVAV) {
-            AV* values = (AV*) SvRV(valueSV);
-            I32 subsize = av_len(values)+1;
-            for (int j = 0; j < subsize; ++j) {
-                string value;
-                SV** valref = av_fetch(values, j, 0);
-                if (valref && SvOK(*valref)) {
-                    STRLEN vlen;
-                    char* vstr = SvPV(*valref, vlen);
-                    value.assign(vstr, vlen, string::COPY);
-                }
-                query->insert(key, value);
+// the same order as Query keeps params in (perl's hash order is random, so the string would differ from run to run)
+static bool he_key_less (HE* a, HE* b) {
+    I32 alen = HeKLEN(a), blen = HeKLEN(b);
+    int cmp = memcmp(HeKEY(a), HeKEY(b), std::min(alen, blen));
+    return cmp ? cmp < 0 : alen < blen;
+}
+
+void XSURI::build_query (HV* hash, string& dest, char delim) {
+    // the first pass collects entries to sort them and sizes the buffer, so that it is allocated once
+    size_t len     = dest.length();
+    size_t bufsize = len + 1;
+    std::vector<HE*> entries;
+    entries.reserve(HvUSEDKEYS(hash));
+    hv_iterinit(hash);
+    while (HE* he = hv_iternext(hash)) {
+        entries.push_back(he);
+        I32 klen = HeKLEN(he);
+        SV* val  = hv_iterval(hash, he);
+        if (SvROK(val) && SvTYPE(SvRV(val)) == SVt_PVAV) {
+            AV* values = (AV*) SvRV(val);
+            I32 nvals = av_len(values) + 1;
+            for (I32 i = 0; i < nvals; ++i) {
+                SV** elemref = av_fetch(values, i, 0);
+                bufsize += (klen + (elemref ? sv_length(*elemref) : 0))*3 + 2;
             }
         }
-        else {
-            string value;
-            if (SvOK(valueSV)) {
-                STRLEN vlen;
-                char* vstr = SvPV(valueSV, vlen);
-                value.assign(vstr, vlen, string::COPY);
+        else bufsize += (klen + sv_length(val))*3 + 2;
+    }
+    if (bufsize == len + 1) return;
+    std::sort(entries.begin(), entries.end(), he_key_less);
+
+    char* buf = dest.reserve(bufsize);
+    char* ptr = buf + len;
+    for (size_t n = 0; n < entries.size(); ++n) {
+        HE* he = entries[n];
+        const char* key  = HeKEY(he);
+        I32         klen = HeKLEN(he);
+        SV* val = hv_iterval(hash, he);
+        if (SvROK(val) && SvTYPE(SvRV(val)) == SVt_PVAV) {
+            AV* values = (AV*) SvRV(val);
+            I32 nvals = av_len(values) + 1;
+            for (I32 i = 0; i < nvals; ++i) {
+                SV** elemref = av_fetch(values, i, 0);
+                ptr = encode_param(key, klen, elemref ? *elemref : NULL, ptr, buf, delim);
             }
-            query->insert(key, value);
         }
+        else ptr = encode_param(key, klen, val, ptr, buf, delim);
     }
+    dest.resize(ptr - buf);
 }
 
 void XSURI::add_query_args (URI* uri, SV** sp, I32 items, bool replace) {
@@ -84,40 +127,67 @@ void XSURI::add_param (URI* uri, string key, SV* val, bool replace) {
     else uri->query().insert(key, sv2string(val));
 }
 
+// params go straight into query string, Query is only built if it's needed later
 void XSURI::add_query_hv (URI* uri, HV* hash, bool replace) {
-    if (replace) {
-        Query query;
-        hv2query((HV*)hash, &query);
-        uri->query(query);
-        return;
-    }
+    string qstr;
+    build_query(hash, qstr, uri->query_delim());
+    if (replace) uri->query_string(qstr);
+    else         uri->add_query(qstr);
+}
 
-    I32 size = hv_iterinit(hash);
-    char* keystr;
-    I32 keylen;
-    for (I32 i = 0; i < size; ++i) {
-        SV* value = hv_iternextsv(hash, &keystr, &keylen);
-        add_param(uri, string(keystr, keylen, string::COPY), value);
-    }
+static inline void set_value (SV* sv, const string& val) {
+    if (SvPOK(sv) && !SvROK(sv) && !SvUTF8(sv) && SvCUR(sv) == val.length() && !memcmp(SvPVX(sv), val.data(), val.length())) return;
+    sv_setpvn(sv, val.data(), val.length());
+    SvUTF8_off(sv);
 }
 
+/* Updates cached hash in place: values that haven't changed are left as they are and keys are only added or removed when
+ * the set of params' keys changes. Params with the same key come in a row, several values of a key are stored as arrayref. */
 void XSURI::sync_query_hv () const {
     HV* hash;
-    if (query_cache) {
-        hash = (HV*) SvRV(query_cache);
-        hv_clear(hash);
-    }
+    if (query_cache) hash = (HV*) SvRV(query_cache);
     else {
         hash = newHV();
         query_cache = newRV_noinc((SV*)hash);
     }
 
-    const URI* uri = this->uri;
-    Query::const_iterator end = uri->query().cend();
-    for (Query::const_iterator it = uri->query().cbegin(); it != end; ++it)
-        hv_store(hash, it->first.data(), it->first.length(), newSVpvn(it->second.data(), it->second.length()), 0);
+    const Query& query = uri->query();
+    Query::const_iterator end = query.cend();
+    size_t nkeys = 0;
+    for (Query::const_iterator it = query.cbegin(); it != end; ++nkeys) {
+        const string& key = it->first;
+        Query::const_iterator last = it + 1;
+        while (last != end && last->first == key) ++last;
+
+        if (last - it == 1) {
+            SV** ref = hv_fetch(hash, key.data(), key.length(), 1);
+            set_value(*ref, it->second);
+        }
+        else {
+            SV** ref = hv_fetch(hash, key.data(), key.length(), 0);
+            AV*  values;
+            if (ref && SvROK(*ref) && SvTYPE(SvRV(*ref)) == SVt_PVAV) values = (AV*) SvRV(*ref);
+            else {
+                values = newAV();
+                hv_store(hash, key.data(), key.length(), newRV_noinc((SV*)values), 0);
+            }
+            I32 cnt = last - it;
+            av_fill(values, cnt - 1);
+            for (I32 i = 0; i < cnt; ++i, ++it) set_value(*av_fetch(values, i, 1), it->second);
+        }
+        it = last;
+    }
+
+    if ((size_t)HvUSEDKEYS(hash) > nkeys) { // some keys are gone (or have been added to hash by user)
+        hv_iterinit(hash);
+        while (HE* he = hv_iternext(hash)) {
+            STRLEN klen;
+            const char* kstr = HePV(he, klen);
+            if (query.find(string(kstr, klen, string::COPY)) == end) hv_delete(hash, kstr, klen, G_DISCARD);
+        }
+    }
 
-    query_cache_rev = uri->query().rev;
+    query_cache_rev = query.rev;
 }
 
 }}
@@ -1,5 +1,4 @@
 #pragma once
-#include <map>
 #include <xs/xs.h>
 #include <panda/string.h>
 #include <panda/uri/URI.h>
@@ -24,7 +23,9 @@ public:
     void sync_query_hv () const;
 
     SV* query_hv () const {
+        PANDA_URI_STAT(query_hv_sync, 1);
         if (!query_cache || query_cache_rev != uri->query().rev) sync_query_hv();
+        else PANDA_URI_STAT(query_hv_sync_hits, 1);
         return query_cache;
     }
 
@@ -33,6 +34,10 @@ public:
         uri->release();
     }
 
+    // wrappers live as long as perl objects do, so they are never allocated from arena, only reused via free lists
+    static void* operator new    (size_t size) { return panda::uri::pool_allocate(size); }
+    static void  operator delete (void* ptr)   { panda::uri::deallocate(ptr); }
+
     static void register_perl_scheme (const char* scheme, const char* perl_class);
     static SV*  get_perl_class       (const URI* uri);
 
@@ -40,10 +45,10 @@ public:
     static void add_query_hv   (URI* uri, HV*, bool replace = false);
     static void add_param      (URI* uri, string key, SV* val, bool replace = false);
 
-private:
-    typedef std::map<uint64_t, SV*> UriClassMap;
-    static UriClassMap uri_class_map;
+    // encodes params from hash (values may be arrayrefs for multiple values) and appends them to 'dest'
+    static void build_query (HV* hash, string& dest, char delim = '&');
 
+private:
     XSURI (const XSURI& s) {}
     XSURI& operator= (const XSURI& s) { return *this; }
 };
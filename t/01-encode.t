@@ -12,4 +12,32 @@ ok(decode_uri_component("hello+world") eq "hello world");
 ok(decode_uri_component("http%3A%2F%2Fya.ru") eq "http://ya.ru");
 ok(decode_uri_component("hello%20guy%21%20how%20ru%3F%20%D0%BF%D0%B8%D0%B7%D0%B4%D0%B5%D1%86%20%D0%BD%D0%B0%D1%85") eq "hello guy! how ru? пиздец нах");
 
+my $long = join('', map { "abcdefghijklmnopqrstuvwxyz-0123456789_" . ($_ % 3 ? '' : "/?\x{00} ") } 1..20);
+(my $long_encoded = $long) =~ s/([^A-Za-z0-9\-_.~])/sprintf("%%%02X", ord($1))/ge;
+is(encode_uri_component($long), $long_encoded);
+is(decode_uri_component($long_encoded), $long);
+is(decode_uri_component("a" x 40 . "%4"), "a" x 40 . "4");
+is(decode_uri_component("a" x 40 . "%"), "a" x 40);
+
+# vectorized encoding must give the same as the plain per-char rule for every byte at every offset of 16/32-byte blocks and tails
+sub encode_ref {
+    my ($str, $plus) = @_;
+    $str =~ s/([^A-Za-z0-9\-_.~])/($plus && $1 eq ' ') ? '+' : sprintf("%%%02X", ord($1))/ge;
+    return $str;
+}
+foreach my $plus (0, 1) {
+    foreach my $len (0..64) {
+        my $clean = join('', map { chr(ord('a') + $_ % 26) } 1..$len);
+        my $ok = encode_uri_component($clean, $plus) eq $clean;
+        foreach my $byte (0..255) {
+            my $str = $clean . chr($byte) . ('~' x (64 - $len));
+            $ok &&= encode_uri_component($str, $plus) eq encode_ref($str, $plus);
+        }
+        ok($ok, "every byte after $len clean chars" . ($plus ? ' (plus)' : ''));
+    }
+}
+my $all = join('', map { chr } 0..255) x 3;
+is(encode_uri_component($all), encode_ref($all), 'all bytes in a row');
+is(encode_uri_component(substr($all, $_)), encode_ref(substr($all, $_)), "all bytes from offset $_") for 1..33;
+
 done_testing();
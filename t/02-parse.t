@@ -80,6 +80,22 @@ is(Panda::URI->new("http://ya.ru")->relative, "/"); # not empty relative path
 is(Panda::URI->new("http://ya.ru?p1=v1&p2=v2#myhash")->relative, '/?p1=v1&p2=v2#myhash');
 
 # equals
+{
+    my $u1 = Panda::URI->new("http://ya.ru/a?b=1#c");
+    my $u2 = Panda::URI->new("http://ya.ru:80/a?b=1#c");
+    ok($u1->equals($u2), "explicit default port");
+    is($u1->hash_code, $u2->hash_code, "hash_code of equal uris");
+    ok($u1->equals($u1->clone), "clone");
+    is($u1->hash_code, $u1->clone->hash_code);
+    $u2->fragment('d');
+    ok(!$u1->equals($u2));
+    isnt($u1->hash_code, $u2->hash_code, "hash_code changes with uri");
+    $u2->fragment('c');
+    is($u1->hash_code, $u2->hash_code);
+    $u2->param(e => 1);
+    ok(!$u1->equals($u2));
+    isnt($u1->hash_code, $u2->hash_code);
+}
 
 # injection
 # null byte in uri. should NOT core dump. Stop parsing url on null byte
@@ -25,10 +25,29 @@ ok(defined $uri->param(''));
 cmp_bag([$uri->multiparam('')], ['', 'empty']);
 ok($query->{p2});
 ok($uri->param('p2'));
-ok(!ref($query->{p2}));
+cmp_deeply($query->{p2}, ['v2', 'v2v2']);
 ok(!ref($uri->param('p2')));
 cmp_bag([$uri->multiparam('p2')], ['v2', 'v2v2']);
 
+# cached hash is updated in place
+is($uri->query, $query);
+$uri->param(p1 => 'v1');
+is($query->{p1}, 'v1');
+$uri->param(p1 => 'new');
+is($uri->query, $query);
+is($query->{p1}, 'new');
+$uri->remove_param('p2');
+$uri->param(p3 => [1, 2]);
+$uri->query;
+ok(!exists $query->{p2});
+cmp_deeply($query->{p3}, [1, 2]);
+$uri->param(p3 => ['one']);
+$uri->query;
+is($query->{p3}, 'one');
+$query->{garbage} = 1;
+$uri->param(p1 => 'newer');
+cmp_deeply($uri->query, {p1 => 'newer', p3 => 'one', empty => '', '' => ['empty', '']});
+
 $uri->query({a => 1, "key space" => 2, b => "val space", multi => [1,2,3], "" => 'emtpy'});
 my $qstr = $uri->query_string;
 like($qstr, '/(^|&)a=1(&|$)/');
@@ -39,6 +58,24 @@ like($qstr, '/(^|&)multi=2(&|$)/');
 like($qstr, '/(^|&)multi=3(&|$)/');
 like($qstr, '/(^|&)=emtpy(&|$)/');
 
+is(Panda::URI::build_query({}), '');
+is(Panda::URI::build_query({a => 1}), 'a=1');
+is(Panda::URI::build_query({"key space" => "val&ue", e => undef}), 'e=&key%20space=val%26ue');
+is(Panda::URI::build_query({a => [1, 2], b => [], c => 'd'}), 'a=1&a=2&c=d');
+is(Panda::URI::build_query({a => [1, 2]}, PARAM_DELIM_SEMICOLON), 'a=1;a=2');
+
+# hashes are written sorted by key, so the string doesn't depend on perl's hash order
+my %h = map { ("k$_" => $_) } reverse 1..20;
+my $sorted = join '&', map { "$_=$h{$_}" } sort keys %h;
+is(Panda::URI::build_query(\%h), $sorted);
+$uri = new Panda::URI("http://ya.ru/p");
+$uri->query(\%h);
+is($uri->to_string, "http://ya.ru/p?$sorted");
+$uri = new Panda::URI("http://ya.ru/p?z=1");
+$uri->add_query({b => 2, a => [3, 1], c => 4});
+is($uri->to_string, "http://ya.ru/p?z=1&a=3&a=1&b=2&c=4");
+is(Panda::URI::http->new("http://ya.ru/p", {x => 1, ab => 2, a => 3})->to_string, "http://ya.ru/p?a=3&ab=2&x=1");
+
 $uri = new Panda::URI("https://ya.ru/my/path?a=b");
 $uri->add_query('');
 is($uri, "https://ya.ru/my/path?a=b");
@@ -81,6 +118,26 @@ like($uri, '/c=d%20e/');
 $uri = new Panda::URI("https://ya.ru/my/path?a=b;e=f;c=d%20e", PARAM_DELIM_SEMICOLON);
 cmp_deeply($uri->query, {a => 'b', e => 'f', c => 'd e'});
 like($uri->query_string, '/[^;]+;[^;]+;[^;]+/');
+$uri->add_query({g => 'h'});
+is($uri->query_string, 'a=b;e=f;c=d%20e;g=h');
+is($uri->param('g'), 'h');
+
+# param lookup without parsing query
+$uri = new Panda::URI("http://ya.ru/?a%20b=1&c=2&a+b=3&d&e=%3D");
+is($uri->param('a b'), '1');
+cmp_deeply([$uri->multiparam('a b')], ['1', '3']);
+is($uri->param('d'), '');
+is($uri->param('e'), '=');
+ok(!defined $uri->param('a'));
+is($uri->nparam, 5);
+
+$uri = new Panda::URI("http://ya.ru/?b=1&a=2&b=3&c=4");
+$uri->param('d', 5);
+is($uri->query_string, 'a=2&b=1&b=3&c=4&d=5');
+$uri = new Panda::URI("http://ya.ru/?b=1&a=2&b=3&c=4", QUERY_KEEP_ORDER);
+$uri->param('d', 5);
+is($uri->query_string, 'b=1&b=3&a=2&c=4&d=5');
+cmp_deeply([$uri->multiparam('b')], ['1', '3']);
 
 # bug test (no sync query for param())
 $uri = Panda::URI->new("https://graph.facebook.com/v2.2?fields=id%2Cfirst_name%2Clast_name%2Cname%2Cgender%2Cbirthday%2Clink&ids=me&include_headers=false");
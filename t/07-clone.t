@@ -21,4 +21,25 @@ $cloned = $uri->clone;
 is(ref($uri), 'Panda::URI::http');
 is(ref($cloned), 'Panda::URI::http');
 
+# parsed query is shared until changed
+my $base = uri("http://api.com/v1?a=1&b=2&c=3");
+is_deeply($base->query, {a => 1, b => 2, c => 3});
+my $c1 = $base->clone;
+my $c2 = $base->clone;
+$c1->param(b => 'x');
+$c2->add_query({d => 4});
+is($c1, 'http://api.com/v1?a=1&b=x&c=3');
+is($c2, 'http://api.com/v1?a=1&b=2&c=3&d=4');
+is($base, 'http://api.com/v1?a=1&b=2&c=3');
+$base->param(a => 'y');
+is($base, 'http://api.com/v1?a=y&b=2&c=3');
+is_deeply($c1->query, {a => 1, b => 'x', c => 3});
+
+# shared params outlive the uri they were parsed by
+my $c3 = $base->clone;
+undef $base;
+is($c3, 'http://api.com/v1?a=y&b=2&c=3');
+$c3->param(e => 5);
+is_deeply($c3->query, {a => 'y', b => 2, c => 3, e => 5});
+
 done_testing();
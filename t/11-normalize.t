@@ -0,0 +1,39 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri :const/;
+
+sub test_norm {
+    my ($url, $expected, $sort) = @_;
+    my $uri = uri($url);
+    my $str = $uri->to_string;
+    is($uri->normalized_string($sort), $expected, "normalized_string: $url");
+    is($uri->to_string, $str, "object is not changed: $url");
+    $uri->normalize($sort);
+    is($uri->to_string, $expected, "normalize: $url");
+}
+
+test_norm('HTTP://Example.COM/', 'http://example.com/');
+test_norm('http://example.com:80/a', 'http://example.com/a');
+test_norm('https://example.com:443', 'https://example.com');
+test_norm('https://example.com:80/', 'https://example.com:80/');
+test_norm('http://example.com/%7euser/%2fa%2Fb', 'http://example.com/~user/%2Fa%2Fb');
+test_norm('http://example.com/a/./b/../c/', 'http://example.com/a/c/');
+test_norm('http://example.com/a/b/../../..', 'http://example.com/');
+test_norm('http://example.com/%2E%2E/a', 'http://example.com/a');
+test_norm('http://example.com/?b=%3a&a=%41', 'http://example.com/?b=%3A&a=A');
+test_norm('http://example.com/?b=2&a=1&b=1&c', 'http://example.com/?a=1&b=2&b=1&c', 1);
+test_norm('http://example.com/?a=1&b=2', 'http://example.com/?a=1&b=2', 1);
+test_norm('http://example.com/#%7e%3a', 'http://example.com/#~%3A');
+test_norm('mailto:Joe@Example.COM', 'mailto:Joe@Example.COM');
+test_norm('//[AB::CD]:8080/', '//[ab::cd]:8080/');
+test_norm('http://[FE80::1%25ETH0]/', 'http://[fe80::1%25eth0]/');
+test_norm('http://[FE80::1%25Eth0]:80/A', 'http://[fe80::1%25eth0]/A');
+
+my $uri = uri("http://example.com/?b=1&a=2", QUERY_KEEP_ORDER);
+is($uri->param('b'), 1);
+$uri->normalize(1);
+is($uri->query_string, 'a=2&b=1');
+is($uri->nparam, 2);
+
+done_testing();
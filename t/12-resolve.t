@@ -0,0 +1,58 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri :const/;
+
+# RFC 3986 5.4
+my $base = uri("http://a/b/c/d;p?q");
+my %tests = (
+    'g:h'           => 'g:h',
+    'g'             => 'http://a/b/c/g',
+    './g'           => 'http://a/b/c/g',
+    'g/'            => 'http://a/b/c/g/',
+    '/g'            => 'http://a/g',
+    '//g'           => 'http://g',
+    '?y'            => 'http://a/b/c/d;p?y',
+    'g?y'           => 'http://a/b/c/g?y',
+    '#s'            => 'http://a/b/c/d;p?q#s',
+    'g#s'           => 'http://a/b/c/g#s',
+    ';x'            => 'http://a/b/c/;x',
+    ''              => 'http://a/b/c/d;p?q',
+    '.'             => 'http://a/b/c/',
+    '..'            => 'http://a/b/',
+    '../g'          => 'http://a/b/g',
+    '../..'         => 'http://a/',
+    '../../../../g' => 'http://a/g',
+    '/../g'         => 'http://a/g',
+    'g.'            => 'http://a/b/c/g.',
+    '..g'           => 'http://a/b/c/..g',
+    './../g'        => 'http://a/b/g',
+    'g/../h'        => 'http://a/b/c/h',
+    'g;x=1/../y'    => 'http://a/b/c/y',
+    'g?y/../x'      => 'http://a/b/c/g?y/../x',
+    'g#s/../x'      => 'http://a/b/c/g#s/../x',
+);
+
+while (my ($ref, $expected) = each %tests) {
+    is($base->resolve($ref), $expected, "resolve '$ref'");
+    is(uri($ref)->abs($base), $expected, "abs '$ref'");
+}
+
+my @refs = sort keys %tests;
+is_deeply($base->resolve([@refs, undef]), [@tests{@refs}, undef], 'batch resolve');
+
+my $abs = uri("/x")->abs(uri("https://ya.ru/a/b"));
+isa_ok($abs, 'Panda::URI::https');
+is($abs->port, 443);
+is(uri("x/y")->abs(uri("http://ya.ru")), "http://ya.ru/x/y");
+
+# references are parsed with base's flags
+my $strict = uri("http://a/b/c/d;p?q", VALIDATE);
+is($strict->resolve("g?y"), "http://a/b/c/g?y", 'valid reference under VALIDATE');
+ok(!eval { $strict->resolve("http://ya.ru:80a/"); 1 }, 'invalid reference under VALIDATE croaks');
+like($@, qr/invalid port at offset 15/);
+ok(!eval { $strict->resolve(["g", "http://ya.ru:99999/"]); 1 }, 'invalid reference in batch croaks');
+like($@, qr/invalid port at offset 17/);
+is($base->resolve("http://ya.ru:80a/"), "http://ya.ru:80/", 'forgiving without VALIDATE');
+
+done_testing();
@@ -0,0 +1,36 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri/;
+
+my @keys = qw/parse parse_bytes to_string to_string_hits to_string_bytes query_sync query_sync_hits parse_query_bytes
+              qstr_sync qstr_sync_hits qstr_sync_bytes query_hv_sync query_hv_sync_hits encode encode_bytes decode decode_skips
+              decode_bytes/;
+
+Panda::URI::reset_stats();
+my $st = Panda::URI::stats();
+is_deeply([sort keys %$st], [sort @keys], 'all counters present');
+is($st->{$_}, 0, "$_ is zero after reset") for @keys;
+
+my $uri = uri("http://ya.ru/my/path?a=1&b=2");
+$uri->to_string for 1..3;
+my $q = $uri->query;
+$q = $uri->query;
+
+$st = Panda::URI::stats();
+if ($st->{parse}) { # built with -DPANDA_URI_STATS
+    is($st->{parse}, 1, 'parse');
+    is($st->{parse_bytes}, 28, 'parse_bytes');
+    is($st->{to_string}, 3, 'to_string');
+    is($st->{to_string_hits}, 2, 'to_string_hits');
+    is($st->{query_hv_sync}, 2, 'query_hv_sync');
+    ok($st->{query_sync} >= 1, 'query_sync');
+}
+else {
+    is($st->{$_}, 0, "$_ is zero without PANDA_URI_STATS") for @keys;
+}
+
+Panda::URI::reset_stats();
+is(Panda::URI::stats()->{parse}, 0, 'reset');
+
+done_testing();
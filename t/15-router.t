@@ -0,0 +1,66 @@
+use strict;
+use warnings;
+use Test::More;
+use Test::Deep;
+use Panda::URI qw/uri/;
+
+my $router = Panda::URI::Router->new;
+my @patterns = ('/', '/users', '/users/:id', '/users/:id/posts/*', '/users/me', '/files/*path', '/a/:x/c', '/a/b/d', '/my%20docs/:doc');
+my %id;
+$id{$_} = $router->add($_) for @patterns;
+is($router->size, scalar @patterns);
+is($id{'/'}, 0);
+is($router->pattern($id{'/users/:id'}), '/users/:id');
+cmp_deeply([$router->params($id{'/users/:id/posts/*'})], ['id', '*']);
+cmp_deeply([$router->params($id{'/files/*path'})], ['path']);
+
+ok(!eval { $router->add('users'); 1 }, 'no leading slash');
+ok(!eval { $router->add('/a/*/b'); 1 }, 'misplaced *');
+ok(!eval { $router->add('/u/:'); 1 }, 'empty param name');
+ok(!eval { $router->add('/users/:name'); 1 }, 'duplicate');
+is($router->size, scalar @patterns);
+
+my @cases = (
+    ['',                          '/'],
+    ['/',                         '/'],
+    ['/users/',                   '/users'],
+    ['/users/42',                 '/users/:id', '42'],
+    ['//users//42/',              '/users/:id', '42'],
+    ['/users/me',                 '/users/me'],
+    ['/users/me/posts/new',       '/users/:id/posts/*', 'me', 'new'],
+    ['/users/4%202/posts/a/b%20c','/users/:id/posts/*', '4 2', 'a/b c'],
+    ['/users/42/posts',           '/users/:id/posts/*', '42', ''],
+    ['/files/a/b',                '/files/*path', 'a/b'],
+    ['/a/b/c',                    '/a/:x/c', 'b'],
+    ['/a/b/d',                    '/a/b/d'],
+    ['/my%20docs/x',              '/my%20docs/:doc', 'x'],
+);
+foreach my $row (@cases) {
+    my ($path, $pattern, @captures) = @$row;
+    cmp_deeply([$router->match($path)], [$id{$pattern}, @captures], "match $path");
+}
+cmp_deeply([$router->match('/a/b/e')], [], 'no match');
+cmp_deeply([$router->match('/nope')], [], 'no match');
+cmp_deeply([$router->match_uri(uri("http://ya.ru/users/5?a=b"))], [$id{'/users/:id'}, '5'], 'match_uri');
+
+cmp_deeply([$router->match('/files/a%2Fb')], [$id{'/files/*path'}, 'a/b'], 'rest of the path is decoded');
+
+# rejected patterns must leave no nodes behind
+my $many = join('', map { "/:p$_" } 1..17);
+ok(!eval { $router->add($many); 1 }, 'too many captures');
+like($@, qr/too many captures/);
+cmp_deeply([$router->match(join('', ('/x') x 17))], [], 'nothing left from rejected pattern');
+cmp_deeply([$router->match(join('', ('/x') x 40))], [], 'long path');
+ok(!eval { $router->add('/q/:a/*/b'); 1 }, 'misplaced * again');
+cmp_deeply([$router->match('/q/1/2')], [], 'nothing left from misplaced *');
+my $max = join('', map { "/:p$_" } 1..16);
+my $max_id = $router->add($max);
+cmp_deeply([$router->match(join('', map { "/$_" } 1..16))], [$max_id, 1..16], 'max captures');
+ok(!eval { $router->add("$max/*"); 1 }, 'one more capture');
+cmp_deeply([$router->match(join('', map { "/$_" } 1..17))], [], 'no rest after max captures');
+
+$router->clear;
+is($router->size, 0);
+cmp_deeply([$router->match('/users')], []);
+
+done_testing();
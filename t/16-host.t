@@ -0,0 +1,39 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri uri_error :const/;
+
+my @cases = (
+    ['http://ya.ru/',             HOST_REG_NAME],
+    ['/path',                     HOST_NONE],
+    ['http://1.2.3.4:80/',        HOST_IPV4, pack('C4', 1, 2, 3, 4)],
+    ['http://01.2.3.4/',          HOST_REG_NAME],
+    ['http://256.1.1.1/',         HOST_REG_NAME],
+    ['http://123.example.com/',   HOST_REG_NAME],
+    ['http://[::1]:8080/',        HOST_IPV6, "\0" x 15 . "\1"],
+    ['http://[fe80::1%25eth0]/',  HOST_IPV6, "\xfe\x80" . "\0" x 13 . "\1", 'eth0'],
+    ['http://[v1.fe80::a]/',      HOST_IPVFUTURE],
+    ['http://[::zz]/',            HOST_INVALID],
+    ['http://[fe80::1%25]/',      HOST_INVALID],
+);
+foreach my $row (@cases) {
+    my ($url, $type, $addr, $zone) = @$row;
+    my $uri = uri($url);
+    is($uri->host_type, $type, "type: $url");
+    is($uri->host_addr, $addr, "addr: $url");
+    is($uri->host_zone, $zone // '', "zone: $url");
+    is($uri->to_string, $url, "to_string: $url");
+    is(!!uri_error($url, VALIDATE), $type == HOST_INVALID, "validate: $url");
+}
+
+my $uri = uri("http://ya.ru/");
+$uri->host('10.0.0.1');
+is($uri->host_type, HOST_IPV4);
+$uri->location('[::1]:81');
+is($uri->host_type, HOST_IPV6);
+is($uri->port, 81);
+is(uri("rel")->abs($uri)->host_type, HOST_IPV6);
+$uri->host('');
+is($uri->host_type, HOST_NONE);
+
+done_testing();
@@ -0,0 +1,70 @@
+use strict;
+use warnings;
+use Test::More;
+use File::Temp qw/tempfile/;
+use Panda::URI qw/uri/;
+
+my $list = <<'END';
+// comment
+com
+uk
+co.uk
+jp
+*.kawasaki.jp
+!city.kawasaki.jp
+github.io
+
+bad..rule
+END
+
+ok(!Panda::URI::PublicSuffix::loaded(), 'nothing loaded');
+is(uri("http://example.com")->public_suffix, undef, 'no list');
+
+my $blob = Panda::URI::PublicSuffix::compile($list);
+Panda::URI::PublicSuffix::assign($blob);
+ok(Panda::URI::PublicSuffix::loaded(), 'assigned');
+
+my @cases = (
+    ['http://www.example.com/',       'com',             'example.com'],
+    ['http://WWW.Example.COM/',       'COM',             'Example.COM'],
+    ['http://example.com./',          'com',             'example.com'],
+    ['http://com/',                   'com',             undef],
+    ['http://a.b.example.co.uk/',     'co.uk',           'example.co.uk'],
+    ['http://co.uk/',                 'co.uk',           undef],
+    ['http://x.y.foo.kawasaki.jp/',   'foo.kawasaki.jp', 'y.foo.kawasaki.jp'],
+    ['http://kawasaki.jp/',           'jp',              'kawasaki.jp'],
+    ['http://www.city.kawasaki.jp/',  'kawasaki.jp',     'city.kawasaki.jp'],
+    ['http://me.github.io/',          'github.io',       'me.github.io'],
+    ['http://host.unknown/',          'unknown',         'host.unknown'],
+    ['http://a..com/',                undef,             undef],
+    ['http://127.0.0.1/',             undef,             undef],
+    ['http://[::1]/',                 undef,             undef],
+    ['/path',                         undef,             undef],
+);
+foreach my $row (@cases) {
+    my ($url, $suffix, $domain) = @$row;
+    my $uri = uri($url);
+    is($uri->public_suffix, $suffix, "suffix: $url");
+    is($uri->registrable_domain, $domain, "domain: $url");
+}
+
+my $uri = uri("http://example.com/");
+$uri->host('foo.bar.co.uk');
+is($uri->registrable_domain, 'bar.co.uk', 'after host change');
+
+my ($fh, $file) = tempfile(UNLINK => 1);
+binmode $fh;
+print $fh Panda::URI::PublicSuffix::compile("org\n");
+close $fh;
+Panda::URI::PublicSuffix::load($file);
+is(uri("http://www.example.org/")->registrable_domain, 'example.org', 'loaded from file');
+is(uri("http://www.example.co.uk/")->registrable_domain, 'co.uk', 'previous list replaced');
+
+ok(!eval { Panda::URI::PublicSuffix::assign("garbage"); 1 }, 'invalid blob croaks');
+ok(!eval { Panda::URI::PublicSuffix::load("$file.none"); 1 }, 'missing file croaks');
+ok(Panda::URI::PublicSuffix::loaded(), 'list kept after errors');
+
+Panda::URI::PublicSuffix::clear();
+ok(!Panda::URI::PublicSuffix::loaded(), 'cleared');
+
+done_testing();
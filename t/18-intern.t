@@ -0,0 +1,56 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri/;
+
+is(Panda::URI::intern_stats(), undef, 'no pool yet');
+
+Panda::URI::intern(1, 100, 10);
+my $st = Panda::URI::intern_stats();
+is($st->{size}, 0, 'empty pool');
+
+my $u1 = uri("http://ya.ru/a?key=1&key=2&other=3");
+my $u2 = uri("http://ya.ru/b?key=4");
+is_deeply([sort keys %{$u1->query}], ['key', 'other'], 'query keys');
+is_deeply($u2->query, {key => 4}, 'query');
+is($u1->host, 'ya.ru', 'host');
+
+$st = Panda::URI::intern_stats();
+is($st->{size}, 3, 'distinct strings');
+is($st->{lookups}, 6, 'lookups');
+is($st->{hits}, 3, 'hits');
+ok($st->{bytes} > 0, 'bytes');
+
+my $long = uri("http://very-long-host.com/?a_very_long_key=1");
+is($long->host, 'very-long-host.com', 'long host is not interned');
+is_deeply($long->query, {a_very_long_key => 1}, 'long key is not interned');
+is(Panda::URI::intern_stats()->{size}, 3, 'long values skipped');
+
+ok(uri("http://ya.ru/a?b=1")->equals(uri("http://ya.ru/a?b=1")), 'equals');
+ok(!uri("http://ya.ru/a?b=1")->equals(uri("http://ya.rv/a?b=1")), 'not equals');
+
+my $u3 = uri("http://ya.ru/");
+$u3->host('YA.ru');
+is($u3->host, 'YA.ru', 'changed host');
+$u3->normalize;
+is($u3->host, 'ya.ru', 'normalized host');
+is(uri("http://ya.ru/")->host, 'ya.ru', 'pool not affected by changes');
+
+Panda::URI::intern(0);
+my $size = Panda::URI::intern_stats()->{size};
+uri("http://new.host/?newkey=1")->query;
+is(Panda::URI::intern_stats()->{size}, $size, 'disabled');
+Panda::URI::intern();
+uri("http://new.host/")->host;
+is(Panda::URI::intern_stats()->{size}, $size + 1, 'enabled again');
+
+Panda::URI::intern(1, 100, 10);
+pass('same limits are fine');
+ok(!eval { Panda::URI::intern(1, 200); 1 }, 'other max_size croaks');
+like($@, qr/max_size=100 and max_len=10/);
+ok(!eval { Panda::URI::intern(1, 100, 20); 1 }, 'other max_len croaks');
+Panda::URI::intern(0, 200);
+pass('limits are ignored when disabling');
+Panda::URI::intern();
+
+done_testing();
@@ -0,0 +1,46 @@
+use strict;
+use warnings;
+use Test::More;
+use Config;
+use Panda::URI qw/uri/;
+
+SKIP: { # the scenario needs C++ access, so it's only compiled in with PANDA_URI_TEST=1 perl Makefile.PL
+    skip 'built without PANDA_URI_TEST', 3 unless defined &Panda::URI::_arena_test;
+    is(
+        Panda::URI::_arena_test("http://ya.ru/p?a=1", "b=2&c=3"),
+        "http://ya.ru/p?b=2&c=3&heap=1 http://ya.ru/p?a=1&shared=1",
+        'uris from outside of arena scope outlive the arena',
+    ) for 1..3;
+}
+
+# wrappers and query storage come from free lists, recycled objects must not keep anything
+for my $i (1..50) {
+    my $u = uri("http://ya.ru/$i?k$i=$i");
+    is_deeply($u->query, {"k$i" => $i}, "recycled wrapper $i") if $i % 10 == 0;
+    $u->add_query({x => $i});
+}
+my $fresh = Panda::URI::http->new("http://ya.ru/");
+is_deeply($fresh->query, {}, 'fresh query');
+is($fresh->to_string, "http://ya.ru/", 'fresh uri');
+
+my @list = map { uri("http://ya.ru/?n=$_") } 1..20;
+undef $list[$_] for grep { $_ % 2 } 0..19;
+push @list, map { uri("http://yb.ru/?m=$_") } 1..10;
+is(join(',', map { $_->query->{n} // $_->query->{m} } grep { defined } @list), join(',', (map { $_*2-1 } 1..10), 1..10), 'live uris intact');
+
+SKIP: {
+    skip 'no ithreads', 1 unless $Config{useithreads};
+    require threads;
+    my @thr = map { threads->create(sub {
+        my $ret = '';
+        for my $i (1..100) {
+            my $u = uri("http://ya.ru/?t=$i");
+            $u->add_query({x => 1});
+            $ret = $u->to_string;
+        }
+        return $ret;
+    }) } 1..4;
+    is_deeply([map { $_->join } @thr], [("http://ya.ru/?t=100&x=1") x 4], 'free lists in threads');
+}
+
+done_testing();
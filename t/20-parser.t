@@ -0,0 +1,57 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri :const/;
+
+my @urls = (
+    'http://user:pw@ya.ru:8080/a/b%20c?x=1&y=%41#frag',
+    'https://[fe80::1%25eth0]:443/p',
+    'ya.ru:8080/path?q',
+    'mailto:joe@example.com',
+    '/only/path?a=b',
+    '',
+);
+
+foreach my $flags (0, ALLOW_LEADING_AUTHORITY, VALIDATE) {
+    foreach my $url (@urls) {
+        my $expected = uri($url, $flags);
+        my $parser = Panda::URI::Parser->new($flags);
+        my $ok = 1;
+        for my $i (0..length($url)) { # split at every offset
+            $ok &&= $parser->feed(substr($url, 0, $i));
+            $ok &&= $parser->feed(substr($url, $i));
+            my $uri = $parser->finish;
+            $ok &&= ref($uri) eq ref($expected) && $uri->to_string eq $expected->to_string && $uri->port == $expected->port;
+        }
+        ok($ok, "split at every offset ($flags): $url");
+        is($parser->length, 0, 'parser is reset after finish');
+    }
+}
+
+my $parser = Panda::URI::Parser->new(0, 10);
+ok($parser->feed("http://"), 'within max_length');
+ok(!$parser->feed("abcd"), 'chunk exceeding max_length is rejected');
+is($parser->length, 7, 'rejected chunk is not taken');
+ok($parser->feed("abc"), 'fits');
+is($parser->finish->to_string, 'http://abc', 'result');
+
+$parser = Panda::URI::Parser->new(VALIDATE);
+ok($parser->feed("http://ya.ru:8"), 'valid chunk');
+ok(!$parser->feed("0/a b"), 'invalid chunk is rejected');
+is($parser->length, 14, 'invalid chunk is not taken');
+ok(!$parser->valid, 'invalid');
+is($parser->error_offset, 17, 'error offset');
+ok(!$parser->feed("/y"), 'next chunks are rejected');
+ok(!eval { $parser->finish; 1 }, 'finish croaks');
+like($@, qr/invalid path at offset 17/);
+ok($parser->valid, 'reset after error');
+is($parser->error_offset, undef, 'no error');
+ok($parser->feed("http://ya.ru/"), 'ready for next url');
+isa_ok($parser->finish, 'Panda::URI::http');
+
+$parser->reset(VALIDATE);
+$parser->feed("http://ya.ru:80a/");
+ok(!eval { $parser->finish; 1 }, 'invalid port is found by finish');
+like($@, qr/invalid port/);
+
+done_testing();
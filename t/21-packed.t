@@ -0,0 +1,59 @@
+use strict;
+use warnings;
+use Test::More;
+use Panda::URI qw/uri/;
+
+my @urls = (
+    'http://ya.ru/a?b=1&c=2#f',
+    'https://u%40x:p@ya.ru:8443/a%20b?x=%41#f%20r',
+    'ftp://ya.ru',
+    'http://[::1]:65535/x',
+    'mailto:joe@example.com',
+    '/p?a=1;b=2',
+    '?q',
+    '#f',
+    '',
+    'svn+ssh://host/r',
+);
+
+foreach my $url (@urls) {
+    my $uri    = uri($url);
+    my $packed = $uri->packed;
+    my $back   = Panda::URI::from_packed($packed);
+    is(ref($back), ref($uri), "class: $url");
+    ok($back->equals($uri), "round trip: $url");
+    is($back->to_string, $uri->to_string, "to_string: $url");
+    is($back->port, $uri->port, "port: $url");
+    is(length($packed), 18 + length($uri->to_string), "size: $url");
+}
+
+my $long = uri("http://ya.ru/" . ('a' x 70000) . "?q=1#f");
+my $back = Panda::URI::from_packed($long->packed);
+is(length($long->packed), 28 + length($long->to_string), 'long url has wide lengths');
+is($back->query_string, 'q=1', 'long query');
+is($back->fragment, 'f', 'long fragment');
+is(length($back->path), 70001, 'long path');
+
+my $packed = uri($urls[1])->packed;
+my $truncated = 0;
+for my $len (0 .. length($packed) - 1) {
+    $truncated++ unless eval { Panda::URI::from_packed(substr($packed, 0, $len)); 1 };
+}
+is($truncated, length($packed), 'every truncated buffer croaks');
+like(do { eval { Panda::URI::from_packed(substr($packed, 0, 10)) }; $@ }, qr/truncated or malformed/, 'error message');
+ok(!eval { Panda::URI::from_packed($packed . 'x'); 1 }, 'trailing garbage croaks');
+
+# corrupted buffers either croak or give some valid uri, but never read out of bounds
+my ($croaked, $loaded) = (0, 0);
+for my $i (0 .. length($packed) - 1) {
+    for my $bit (0 .. 7) {
+        my $corrupt = $packed;
+        substr($corrupt, $i, 1) = chr(ord(substr($corrupt, $i, 1)) ^ (1 << $bit));
+        my $u = eval { Panda::URI::from_packed($corrupt) };
+        if ($u) { $loaded++; $u->to_string; $u->query; } else { $croaked++ }
+    }
+}
+is($croaked + $loaded, length($packed) * 8, 'corrupted buffers');
+ok($croaked, 'corrupted lengths are detected');
+
+done_testing();